@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui sql
+QT       += core gui sql network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -15,14 +15,29 @@ CONFIG += c++11
 SOURCES += main.cpp \
     gui.cpp \
     database.cpp \
-    fileselectiondialog.cpp
+    fileselectiondialog.cpp \
+    logparser.cpp \
+    messageclassifier.cpp \
+    minhash.cpp \
+    parsedlog.cpp \
+    queryserver.cpp \
+    sessionsnapshot.cpp \
+    unrecordedlines.cpp
 
 HEADERS  += \
     database.h \
     database_p.h \
     gui.h \
     gui_p.h \
-    fileselectiondialog.h
+    fileselectiondialog.h \
+    hashing.h \
+    logparser.h \
+    messageclassifier.h \
+    minhash.h \
+    parsedlog.h \
+    queryserver.h \
+    sessionsnapshot.h \
+    unrecordedlines.h
 
 FORMS    += \
     gui.ui \
@@ -3,9 +3,39 @@
 
 #include "database.h"
 #include "database_p.h"
+#include "sessionsnapshot.h"
+#include "minhash.h"
+#include "messageclassifier.h"
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QThread>
+#include <QSet>
 #include <QDebug>
+#include <functional>
+
+// The text that MinHash signatures are computed from
+static QString
+errorText(const QString& repo, const QString& file, const QString& message)
+{
+	return repo + '/' + file + '\n' + message;
+}
+
+// Estimated similarity above which two errors are considered to be the same
+static const double fuzzyMatchThreshold = 0.6;
+
+// Number of IDs per "IN (...)" list, to keep the statements short
+static const int idBatchSize = 10000;
+
+// Comma-separated IDs for "IN (...)"
+template<typename Container>
+static QString
+idList(const Container& ids)
+{
+	QStringList strings;
+	for (int id : ids)
+		strings << QString::number(id);
+	return strings.join(',');
+}
 
 //======================================================================
 // DATABASE
@@ -13,14 +43,69 @@
 /**********************************************************************\
  * CONSTRUCTOR/DESTRUCTOR
 \**********************************************************************/
-Database::Database(const QString& sqliteFile, QObject* parent)
+Database::Database(const QString& sqliteFile, OpenMode mode, QObject* parent)
 	: QObject(parent)
 	, _db(QSqlDatabase::addDatabase("QSQLITE"))
 	, _sessionListModel(new QStringListModel(this))
 	, _fullModel(new DatabaseModel(this))
 	, _diffModel_L(new DatabaseModel(this))
 	, _diffModel_R(new DatabaseModel(this))
+	, _matchModel(new MatchModel(this))
+	, _matrixModel(new MatrixModel(this))
+	, _summaryModel(new AggregateModel(this))
+	, _fuzzyMatching(false)
+	, _loaderThread(nullptr)
+	, _loader(nullptr)
+	, _snapshotInterval(10)
+	, _dataVersion(-1)
 {
+	qRegisterMetaType<QSharedPointer<SessionTable>>();
+	qRegisterMetaType<QVector<int>>();
+	qRegisterMetaType<QHash<int, QByteArray>>();
+	qRegisterMetaType<SessionMatrix>();
+
+	if (mode == ReadOnly)
+	{
+		// Only the session metadata is needed. The queries run on their own connections.
+		_db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=5000");
+		_db.setDatabaseName(sqliteFile);
+		if (!_db.open())
+			qWarning() << "Failed to open" << sqliteFile;
+		else
+			loadSessions();
+		return;
+	}
+
+	_loaderThread = new QThread(this);
+	_loader = new SessionLoader(sqliteFile);
+	_loader->moveToThread(_loaderThread);
+	connect(_loaderThread, &QThread::finished,
+			_loader, &QObject::deleteLater);
+	connect(_loader, &SessionLoader::loaded,
+			this, &Database::setTable);
+	connect(_loader, &SessionLoader::signaturesLoaded,
+			this, &Database::setSignatures);
+	connect(_loader, &SessionLoader::matrixLoaded,
+			this, &Database::setMatrix);
+	connect(_loader, &SessionLoader::failed,
+			this, &Database::dropFailedLoad);
+	_loaderThread->start();
+
+	setCacheBudget(256);
+
+	// Load the sessions next to the current one while the user isn't
+	// doing anything else
+	_prefetchTimer.setSingleShot(true);
+	_prefetchTimer.setInterval(500);
+	connect(&_prefetchTimer, &QTimer::timeout,
+			this, &Database::prefetchNeighbours);
+
+	for (DatabaseModel* model : {_fullModel, _diffModel_L, _diffModel_R})
+	{
+		connect(model, &DatabaseModel::notesEdited,
+				this, &Database::updateNotes);
+	}
+
 	_db.setDatabaseName(sqliteFile);
 	if (!_db.open())
 	{
@@ -39,10 +124,16 @@ Database::Database(const QString& sqliteFile, QObject* parent)
 			"repo INTEGER REFERENCES Repos(id),"
 			"file TEXT)";
 
+	QString createCategories =
+			"CREATE TABLE IF NOT EXISTS Categories("
+			"id INTEGER PRIMARY KEY,"
+			"name TEXT)";
+
 	QString createMessages =
 			"CREATE TABLE IF NOT EXISTS Messages("
 			"id INTEGER PRIMARY KEY,"
-			"message TEXT)";
+			"message TEXT,"
+			"category INTEGER REFERENCES Categories(id))";
 
 	QString createErrors =
 			"CREATE TABLE IF NOT EXISTS Errors("
@@ -55,7 +146,10 @@ Database::Database(const QString& sqliteFile, QObject* parent)
 			"CREATE TABLE IF NOT EXISTS Sessions("
 			"id INTEGER PRIMARY KEY,"
 			"timestamp TEXT,"
-			"comments TEXT)";
+			"comments TEXT,"
+			"base INTEGER REFERENCES Sessions(id),"
+			"alias INTEGER REFERENCES Sessions(id),"
+			"hash INTEGER)";
 
 	QString createMain =
 			"CREATE TABLE IF NOT EXISTS Main("
@@ -64,32 +158,83 @@ Database::Database(const QString& sqliteFile, QObject* parent)
 			"error INTEGER REFERENCES Errors(id),"
 			"line INTEGER)";
 
+	// Delta-encoded sessions only store their differences from a base
+	// session: Added rows go into Main, removed rows go here
+	QString createRemoved =
+			"CREATE TABLE IF NOT EXISTS Removed("
+			"id INTEGER PRIMARY KEY,"
+			"session INTEGER REFERENCES Sessions(id),"
+			"error INTEGER REFERENCES Errors(id),"
+			"line INTEGER)";
+
+	// Values that describe the database as a whole
+	QString createSettings =
+			"CREATE TABLE IF NOT EXISTS Settings("
+			"name TEXT PRIMARY KEY,"
+			"value)";
+
+	QString createUnrecorded =
+			"CREATE TABLE IF NOT EXISTS Unrecorded("
+			"id INTEGER PRIMARY KEY,"
+			"session INTEGER REFERENCES Sessions(id),"
+			"category INTEGER,"
+			"count INTEGER,"
+			"samples TEXT)";
+
 	QSqlQuery q;
 	if (!q.exec("PRAGMA foreign_keys = ON"))
 		qWarning() << "Enabling foreign keys:" << q.lastError().text();
 
+	// Let the loader thread read while this connection writes
+	if (!q.exec("PRAGMA journal_mode = WAL"))
+		qWarning() << "Enabling write-ahead logging:" << q.lastError().text();
+
 	q.exec(createSessions);
 	q.exec(createRepos);
 	q.exec(createFiles);
+	q.exec(createCategories);
 	q.exec(createMessages);
 	q.exec(createErrors);
 	q.exec(createMain);
+	q.exec(createRemoved);
+	q.exec(createUnrecorded);
+	q.exec(createSettings);
 
-	if (!q.exec("SELECT id,timestamp,comments FROM Sessions"))
-		qWarning() << "Loading Sessions:" << q.lastError().text();
-	while (q.next())
-	{
-		QString entry = simplifyEntry(q.value("timestamp").toDateTime(),
-				q.value("comments").toString());
+	// Upgrade databases created by older versions
+	addColumn("Sessions", "base", "INTEGER REFERENCES Sessions(id)");
+	addColumn("Sessions", "alias", "INTEGER REFERENCES Sessions(id)");
+	addColumn("Sessions", "hash", "INTEGER");
+	addColumn("Errors", "signature", "BLOB");
+	addColumn("Messages", "category", "INTEGER REFERENCES Categories(id)");
 
-		_sessionMap[entry] = q.value("id").toInt();
+	// Older versions inserted every repo again after each restart. Merge the
+	// duplicates, so that each repo is counted under one ID.
+	q.exec("BEGIN");
+	if (!q.exec("UPDATE Files SET repo=("
+			"SELECT MIN(Duplicates.id) FROM Repos JOIN Repos AS Duplicates ON Duplicates.repo=Repos.repo "
+			"WHERE Repos.id=Files.repo) "
+			"WHERE repo NOT IN (SELECT MIN(id) FROM Repos GROUP BY repo)"))
+	{
+		qWarning() << "Merging duplicate Repos in Files:" << q.lastError().text();
 	}
-	refreshSessionList();
+	if (!q.exec("DELETE FROM Repos WHERE id NOT IN (SELECT MIN(id) FROM Repos GROUP BY repo)"))
+		qWarning() << "Deleting duplicate Repos:" << q.lastError().text();
+	q.exec("COMMIT");
+
+	q.exec("CREATE INDEX IF NOT EXISTS MainSessionIndex ON Main(session,error)");
+	q.exec("CREATE INDEX IF NOT EXISTS RemovedSessionIndex ON Removed(session,error,line)");
+	q.exec("CREATE INDEX IF NOT EXISTS ErrorsFileIndex ON Errors(file,message)");
+	q.exec("CREATE INDEX IF NOT EXISTS FilesRepoIndex ON Files(repo)");
+	q.exec("CREATE INDEX IF NOT EXISTS MessagesCategoryIndex ON Messages(category)");
+
+	classifyMessages();
+
+	loadSessions();
 
 	if (!q.exec("SELECT id,repo FROM Repos"))
 		qWarning() << "Loading Repos:" << q.lastError().text();
 	while (q.next())
-		_msgMap[q.value("repo").toString()] = q.value("id").toInt();
+		_repoMap[q.value("repo").toString()] = q.value("id").toInt();
 
 	if (!q.exec("SELECT id,file,message FROM Errors"))
 		qWarning() << "Loading Errors:" << q.lastError().text();
@@ -119,9 +264,30 @@ Database::Database(const QString& sqliteFile, QObject* parent)
 }
 
 
+Database::~Database()
+{
+	if (_loaderThread)
+	{
+		_loaderThread->quit();
+		_loaderThread->wait();
+	}
+	_db.close();
+}
+
+
 /**********************************************************************\
  * PUBLIC
 \**********************************************************************/
+QString
+Database::simplifyEntry(const QDateTime& timestamp, const QString& comments)
+{
+	QString timeString = timestamp.toString("yyyy-MM-dd hh:mm");
+	if (comments.isEmpty())
+		return timeString;
+	else
+		return timeString + " - " + comments;
+}
+
 void
 Database::addSession(const Session& session)
 {
@@ -135,245 +301,2129 @@ Database::addSession(const Session& session)
 		return;
 	}
 
+	const ParsedLog& log = session.log;
+	quint64 logHash = log.hash();
+	QVariant hash = (logHash != 0) ? QVariant(qint64(logHash)) : QVariant();
+
+	// The same log was imported before (perhaps under a different name).
+	// Just point to the existing data.
+	if (logHash != 0 && _hashMap.contains(logHash))
+	{
+		int aliasId = insert("Sessions", Fields()
+				<< Field("timestamp", session.timestamp)
+				<< Field("comments", session.comments)
+				<< Field("alias", _hashMap[logHash])
+				<< Field("hash", hash));
+
+		writeUnrecordedLines(aliasId, session.unrecorded);
+
+		_aliasMap[aliasId] = _hashMap[logHash];
+		_sessionMap[sessionString] = aliasId;
+		refreshSessionList();
+		return;
+	}
+
 	// Use 1 transaction to INSERT everything. Painfully slow otherwise.
 	QSqlQuery q(_db);
 	q.exec("BEGIN");
 
 	int sessionId = insert("Sessions", Fields()
 			<< Field("timestamp", session.timestamp)
-			<< Field("comments", session.comments));
+			<< Field("comments", session.comments)
+			<< Field("hash", hash));
 
-	for (int i = 0; i < session.errors.count(); ++i)
+	// Repos and files are interned by the log, so only look them up once
+	QVector<int> repoIds(log.repoCount());
+	for (int r = 0; r < log.repoCount(); ++r)
 	{
-		const QString& msg = session.errors[i]->message;
-		const QString& repo = session.errors[i]->repo;
-		const QString& file = session.errors[i]->file;
-
+		QString repo = log.repo(r).toString();
 		if (!_repoMap.contains(repo))
 		{
 			_repoMap[repo] = insert("Repos", Fields()
 					<< Field("repo", repo));
 		}
-		int repoId = _repoMap[repo];
-
-		if (!_msgMap.contains(msg))
-		{
-			_msgMap[msg] = insert("Messages", Fields()
-					<< Field("message", msg));
-		}
-		int msgId = _msgMap[msg];
+		repoIds[r] = _repoMap[repo];
+	}
 
-		QString longFilePath = repo + '/' + file;
+	QVector<int> fileIds(log.fileCount());
+	for (int f = 0; f < log.fileCount(); ++f)
+	{
+		QString file = log.file(f).toString();
+		QString longFilePath = log.repo(log.repoIndex(f)).toString() + '/' + file;
 		if (!_fileMap.contains(longFilePath))
 		{
 			_fileMap[longFilePath] = insert("Files", Fields()
-					<< Field("repo", repoId)
+					<< Field("repo", repoIds[log.repoIndex(f)])
 					<< Field("file", file));
 		}
-		int fileId = _fileMap[longFilePath];
+		fileIds[f] = _fileMap[longFilePath];
+	}
+
+	QVector<ErrorLine> rows;
+	rows.reserve(log.count());
+	for (int i = 0; i < log.count(); ++i)
+	{
+		QString msg = log.message(i).toString();
+		if (!_msgMap.contains(msg))
+		{
+			_msgMap[msg] = insert("Messages", Fields()
+					<< Field("message", msg)
+					<< Field("category", log.category(i)));
+		}
+		int msgId = _msgMap[msg];
+		int fileId = fileIds[log.fileIndex(i)];
 
 		quint32 errorKey = (fileId << 16) | msgId;
 		if (!_errorMap.contains(errorKey))
 		{
+			int f = log.fileIndex(i);
+			QByteArray signature = MinHash::signature(errorText(log.repo(log.repoIndex(f)).toString(),
+					log.file(f).toString(), msg));
+
 			_errorMap[errorKey] = insert("Errors", Fields()
 					<< Field("file", fileId)
-					<< Field("message", msgId));
+					<< Field("message", msgId)
+					<< Field("signature", signature));
 		}
 		int errorId = _errorMap[errorKey];
 
-		insert("Main", Fields()
-				<< Field("session", sessionId)
-				<< Field("error", errorId)
-				<< Field("line", session.errors[i]->line));
+		rows << ErrorLine(errorId, log.line(i));
 	}
 
+	writeRows(sessionId, latestSnapshot(), rows);
+	writeUnrecordedLines(sessionId, session.unrecorded);
+
 	// Finalize transaction
 	q.exec("COMMIT");
 
+	// SQLite may reuse the ID of a deleted session
+	_tableCache.remove(sessionId);
+	_summaryModel->clearCache();
+
 	_sessionMap[sessionString] = sessionId;
+	if (logHash != 0)
+		_hashMap[logHash] = sessionId;
 	refreshSessionList();
 }
 
-static const QString coreModelSelection =
-		"SELECT Main.id,Repos.repo,Files.file,Main.line,Messages.message,Errors.notes FROM Main "
-		"JOIN Errors ON Errors.id=Main.error "
-		"JOIN Files ON Files.id=Errors.file "
-		"JOIN Repos ON Repos.id=Files.repo "
-		"JOIN Messages ON Messages.id=Errors.message ";
+// rowSelection is a SELECT statement that produces (id, error, line) rows.
+// See sessionRows() and SessionLoader::load()
+static QString
+coreModelSelection(const QString& rowSelection)
+{
+	return "SELECT Main.id,Main.error,Errors.file,Repos.repo,Files.file,Main.line,"
+			"Errors.message,Messages.message,Errors.notes,Messages.category "
+			"FROM (" + rowSelection + ") AS Main "
+			"JOIN Errors ON Errors.id=Main.error "
+			"JOIN Files ON Files.id=Errors.file "
+			"JOIN Repos ON Repos.id=Files.repo "
+			"JOIN Messages ON Messages.id=Errors.message ";
+}
+
+// Reads the rows produced by coreModelSelection(). Strings are shared between
+// rows. Returns false if isCancelled() returns true before all rows are read.
+static bool
+readSessionTable(QSqlQuery& q, SessionTable* table, const std::function<bool()>& isCancelled)
+{
+	QHash<int, QPair<QString, QString>> files;
+	QHash<int, QString> messages;
+	QHash<int, QString> notes;
+
+	while (q.next())
+	{
+		// Check every 1024 rows
+		if ((table->size() & 0x3ff) == 0 && isCancelled())
+			return false;
+
+		SessionRow row;
+		row.id = q.value(0).toInt();
+		row.error = q.value(1).toInt();
+		row.line = q.value(5).toInt();
+		row.category = q.value(9).toInt();
+
+		int fileId = q.value(2).toInt();
+		if (!files.contains(fileId))
+			files[fileId] = qMakePair(q.value(3).toString(), q.value(4).toString());
+		row.repo = files[fileId].first;
+		row.file = files[fileId].second;
+
+		int msgId = q.value(6).toInt();
+		if (!messages.contains(msgId))
+			messages[msgId] = q.value(7).toString();
+		row.message = messages[msgId];
+
+		if (!notes.contains(row.error))
+			notes[row.error] = q.value(8).toString();
+		row.notes = notes[row.error];
+
+		table->append(row);
+	}
+	return true;
+}
+
+QAbstractTableModel*
+Database::fullModel() const
+{
+	return _fullModel;
+}
+
+QAbstractTableModel*
+Database::diffModel_L() const
+{
+	return _diffModel_L;
+}
+
+QAbstractTableModel*
+Database::diffModel_R() const
+{
+	return _diffModel_R;
+}
+
+QAbstractTableModel*
+Database::matchModel() const
+{
+	return _matchModel;
+}
+
+QAbstractTableModel*
+Database::matrixModel() const
+{
+	return _matrixModel;
+}
+
+QAbstractItemModel*
+Database::summaryModel() const
+{
+	return _summaryModel;
+}
 
 void
 Database::setFullModel(const QString& session)
 {
-	QSqlQuery q(_db);
-	q.prepare(coreModelSelection +
-			"WHERE Main.session=?");
-	q.addBindValue(_sessionMap[session]);
-	q.exec();
-	_fullModel->setQuery(q);
+	// Nothing to do if only the diff partner changed
+	if (session == _fullSession)
+		return;
+
+	_fullSession = session;
+	_prefetchTimer.start();
 
-	// Must forcibly pull all data. Otherwise, the sorted table might have
-	// intermediate rows missing.
-	while (_fullModel->canFetchMore())
-		_fullModel->fetchMore();
+	int sessionId = _sessionMap[session];
+	auto table = cachedTable(sessionId);
+	if (table)
+	{
+		cancelLoad(SessionLoader::FullTable);
+		_fullModel->setTable(table);
+	}
+	else
+		requestTable(SessionLoader::FullTable, sessionId);
 }
 
 void
 Database::setDiffModels(const QString& session1, const QString& session2)
 {
-	QSqlQuery q(_db);
-	q.prepare(coreModelSelection +
-			"WHERE Main.session=? "
-			"AND Main.error NOT IN (SELECT error FROM Main WHERE session=?)");
-	q.addBindValue(_sessionMap[session1]);
-	q.addBindValue(_sessionMap[session2]);
-	q.exec();
-	_diffModel_L->setQuery(q);
-	while (_diffModel_L->canFetchMore())
-		_diffModel_L->fetchMore();
-
-	q.prepare(coreModelSelection +
-			"WHERE Main.session=? "
-			"AND Main.error NOT IN (SELECT error FROM Main WHERE session=?)");
-	q.addBindValue(_sessionMap[session2]);
-	q.addBindValue(_sessionMap[session1]);
-	q.exec();
-	_diffModel_R->setQuery(q);
-	while (_diffModel_R->canFetchMore())
-		_diffModel_R->fetchMore();
+	_diffSession = session2;
+	_prefetchTimer.start();
+
+	// The diffs are computed in memory from the full tables
+	int sessionIds[2] = {_sessionMap[session1], _sessionMap[session2]};
+	int targets[2] = {SessionLoader::DiffTable_L, SessionLoader::DiffTable_R};
+	for (int i = 0; i < 2; ++i)
+	{
+		_diffTables[i] = cachedTable(sessionIds[i]);
+		if (_diffTables[i])
+			cancelLoad(targets[i]);
+		else
+			requestTable(targets[i], sessionIds[i]);
+	}
+
+	updateDiffModels();
 }
 
-/**********************************************************************\
- * PUBLIC SLOTS
-\**********************************************************************/
 void
-Database::removeSession(const QString& session)
+Database::setFuzzyMatching(bool enabled)
 {
-	QSqlQuery q(_db);
-	q.prepare("DELETE FROM Main WHERE session=?");
-	q.addBindValue(_sessionMap[session]);
-	if (!q.exec())
-		qWarning() << "Deleting Session from Main:" << q.lastError().text();
+	if (enabled == _fuzzyMatching)
+		return;
+	_fuzzyMatching = enabled;
 
-	q.prepare("DELETE FROM Sessions WHERE id=?");
-	q.addBindValue(_sessionMap[session]);
-	if (!q.exec())
-		qWarning() << "Deleting Session:" << q.lastError().text();
+	if (!enabled)
+	{
+		_loader->nextGeneration(SessionLoader::Signatures); // Cancel pending loads
+		_matchModel->setMatches(QVector<ErrorMatch>());
+	}
 
-	_sessionMap.remove(session);
-	refreshSessionList();
+	// Recompute the current diff. Its tables are most likely cached.
+	if (!_fullSession.isEmpty() && !_diffSession.isEmpty())
+		setDiffModels(_fullSession, _diffSession);
 }
 
-/**********************************************************************\
- * PRIVATE
-\**********************************************************************/
-QString
-Database::simplifyEntry(const QDateTime& timestamp, const QString& comments)
+void
+Database::setMatrixSessions(QStringList sessions)
 {
-	QString timeString = timestamp.toString("yyyy-MM-dd hh:mm");
-	if (comments.isEmpty())
-		return timeString;
+	// Session names start with the timestamp
+	std::sort(sessions.begin(), sessions.end());
+
+	// Aliases share the rows of another session
+	QVector<int> dataIds;
+	QVector<int> baseIds;
+	for (const QString& session : sessions)
+	{
+		int sessionId = _sessionMap.value(session);
+		sessionId = _aliasMap.value(sessionId, sessionId);
+		dataIds << sessionId;
+		baseIds << _baseMap.value(sessionId);
+	}
+
+	QMetaObject::invokeMethod(_loader, "loadMatrix", Qt::QueuedConnection,
+			Q_ARG(int, _loader->nextGeneration(SessionLoader::Matrix)),
+			Q_ARG(QStringList, sessions),
+			Q_ARG(QVector<int>, dataIds),
+			Q_ARG(QVector<int>, baseIds));
+}
+
+void
+Database::setMatrixFilter(PresenceFilter filter, int n)
+{
+	_matrixModel->setPresenceFilter(filter, n);
+}
+
+void
+Database::setSummaryModel(const QString& session1, const QString& session2)
+{
+	int sessionId1 = _sessionMap.value(session1);
+	int sessionId2 = _sessionMap.value(session2);
+
+	if (session2.isEmpty())
+	{
+		_summaryModel->setRowSelections(QString::number(_aliasMap.value(sessionId1, sessionId1)),
+				QStringList() << sessionRows(sessionId1),
+				QStringList() << "Errors");
+	}
 	else
-		return timeString + " - " + comments;
+	{
+		QString cacheKey = QString("%1-%2")
+				.arg(_aliasMap.value(sessionId1, sessionId1))
+				.arg(_aliasMap.value(sessionId2, sessionId2));
+
+		_summaryModel->setRowSelections(cacheKey,
+				QStringList()
+						<< uniqueRowSelection(session1, session2)
+						<< uniqueRowSelection(session2, session1),
+				QStringList()
+						<< "Unique to " + session1
+						<< "Unique to " + session2);
+	}
 }
 
-int
-Database::insert(const QString& table, QList<QPair<QString, QVariant>> fields)
+UnrecordedLines
+Database::unrecordedLines(const QString& session) const
 {
-	QString columns;
-	QString values;
-	for (int i = 0; i < fields.size(); ++i)
+	UnrecordedLines lines;
+
+	QSqlQuery q(_db);
+	q.prepare("SELECT category,count,samples FROM Unrecorded WHERE session=?");
+	q.addBindValue(_sessionMap[session]);
+	if (!q.exec())
+		qWarning() << "Loading Unrecorded lines:" << q.lastError().text();
+	while (q.next())
 	{
-		columns += fields[i].first + ',';
-		values  += "?,";
+		int category = q.value("category").toInt();
+		if (category < 0 || category >= UnrecordedLines::CategoryCount)
+			continue;
+
+		QStringList samples = q.value("samples").toString().split('\n', QString::SkipEmptyParts);
+		lines.setSummary(category, q.value("count").toInt(), samples);
 	}
-	columns.chop(1); // Remove trailing ','
-	values.chop(1);
 
-	QString query = QString("INSERT INTO %1(%2) VALUES(%3)")
-			.arg(table).arg(columns).arg(values);
+	return lines;
+}
+
+bool
+Database::exportSnapshot(const QString& session, const QString& filename)
+{
+	int sessionId = _sessionMap.value(session);
+	if (sessionId == 0)
+		return false;
 
 	QSqlQuery q(_db);
-	q.prepare(query);
-	for (int i = 0; i < fields.size(); ++i)
-		q.addBindValue(fields[i].second);
+	q.prepare("SELECT timestamp,comments FROM Sessions WHERE id=?");
+	q.addBindValue(sessionId);
+	if (!q.exec() || !q.next())
+	{
+		qWarning() << "Exporting Session:" << q.lastError().text();
+		return false;
+	}
+	QDateTime timestamp = q.value("timestamp").toDateTime();
+	QString comments = q.value("comments").toString();
+	q.finish();
 
-	if (!q.exec())
+	// Only read the session if it isn't loaded already
+	QSharedPointer<SessionTable> table = cachedTable(sessionId);
+	if (!table)
 	{
-		qWarning() << "Inserting into" << table << ':' << q.lastError().text();
-		return -1;
+		q.setForwardOnly(true);
+		if (!q.exec(coreModelSelection(sessionRows(sessionId))))
+		{
+			qWarning() << "Exporting Session:" << q.lastError().text();
+			return false;
+		}
+
+		table.reset(new SessionTable);
+		readSessionTable(q, table.data(), []() {return false;});
 	}
-	return q.lastInsertId().toInt();
+
+	return SessionSnapshot::write(filename, timestamp, comments, *table);
 }
 
-void
-Database::refreshSessionList()
+QString
+Database::rowSelection(const QString& session) const
 {
-	auto sessions = _sessionMap.keys();
-	std::sort(sessions.begin(), sessions.end());
-	std::reverse(sessions.begin(), sessions.end());
-	_sessionListModel->setStringList(sessions);
+	if (!_sessionMap.contains(session))
+		return QString();
+	return sessionRows(_sessionMap[session]);
+}
 
-	// TODO: Clear table models if session list changed
+QString
+Database::uniqueRowSelection(const QString& session, const QString& otherSession) const
+{
+	if (!_sessionMap.contains(session) || !_sessionMap.contains(otherSession))
+		return QString();
+
+	QString rows = sessionRows(_sessionMap[session]);
+	QString otherRows = sessionRows(_sessionMap[otherSession]);
+	return "SELECT * FROM (" + rows + ") WHERE error NOT IN (SELECT error FROM (" + otherRows + "))";
 }
 
-//======================================================================
-// DATABASEMODEL
-//======================================================================
-Qt::ItemFlags
-DatabaseModel::flags(const QModelIndex& index) const
+QMap<int, QString>
+Database::sessionNames() const
 {
-	// Only notes can be updated manually
-	Qt::ItemFlags flags = QSqlQueryModel::flags(index);
-	if (headerData(index.column(), Qt::Horizontal) == "notes")
-		flags |= Qt::ItemIsEditable;
+	QMap<int, QString> names;
+	for (auto it = _sessionMap.constBegin(); it != _sessionMap.constEnd(); ++it)
+		names[it.value()] = it.key();
+	return names;
+}
 
-	return flags;
+void
+Database::refreshSessions()
+{
+	// The data version changes whenever another connection commits
+	QSqlQuery q(_db);
+	int version = -1;
+	if (q.exec("PRAGMA data_version") && q.next())
+		version = q.value(0).toInt();
+
+	if (version >= 0 && version == _dataVersion)
+		return;
+	_dataVersion = version;
+
+	loadSessions();
+	_tableCache.clear();
+	_summaryModel->clearCache();
 }
 
-bool
-DatabaseModel::setData(const QModelIndex& index, const QVariant& value, int /*role*/)
+// Converts a pattern where '*' matches any text into GLOB syntax
+static QString
+globPattern(const QString& wildcards)
 {
-	// Only notes can be updated manually
-	if (headerData(index.column(), Qt::Horizontal) != "notes")
-		return false;
+	if (wildcards.isEmpty())
+		return "*";
 
-	// TODO: Grab indices in a more robust manner
-	QModelIndex repoIndex = this->index(index.row(), 1);
-	QModelIndex fileIndex = this->index(index.row(), 2);
-	QModelIndex msgIndex = this->index(index.row(), 4);
+	QString glob;
+	for (QChar c : wildcards)
+	{
+		if (c == '?' || c == '[')
+			glob += QString("[") + c + ']';
+		else
+			glob += c;
+	}
+	return glob;
+}
 
-	// Update error notes. Errors are considered identical if the same message
-	// originates from the same file
-	QString updateQuery =
-			"UPDATE Errors SET notes=? "
-			"WHERE file="
-			"    (SELECT id FROM Files WHERE file=? AND repo="
-			"        (SELECT id FROM Repos WHERE repo=?)"
-			"    ) "
-			"AND message="
-			"    (SELECT id FROM Messages WHERE message=?)";
+int
+Database::annotateErrors(const QList<int>& errorIds, const QString& notes)
+{
+	QSet<int> annotated;
 
 	QSqlQuery q;
-	q.prepare(updateQuery);
-	q.addBindValue(value);
-	q.addBindValue(data(fileIndex));
-	q.addBindValue(data(repoIndex));
-	q.addBindValue(data(msgIndex));
-	bool ok = q.exec();
-
-	// Refresh. Block modelAboutToBeReset()/modelReset() signals
-	// to maintain the views' sort order and scroll position
-	if (ok)
+	q.exec("BEGIN");
+	q.prepare("UPDATE Errors SET notes=? WHERE id=?");
+	for (int errorId : errorIds)
 	{
-		q = this->query();
-		q.exec();
+		if (annotated.contains(errorId))
+			continue;
 
-		this->blockSignals(true);
-		this->setQuery(q);
-		while (canFetchMore())
-			fetchMore();
-		this->blockSignals(false);
+		q.addBindValue(notes);
+		q.addBindValue(errorId);
+		if (!q.exec())
+		{
+			qWarning() << "Annotating Errors:" << q.lastError().text();
+			q.exec("ROLLBACK");
+			return 0;
+		}
+		annotated << errorId;
 	}
+	q.exec("COMMIT");
+
+	refreshNotes(annotated, notes);
+	return annotated.size();
+}
+
+int
+Database::annotateMatching(const QString& pathPattern, const QString& messagePattern, const QString& notes)
+{
+	QSqlQuery q;
+	q.setForwardOnly(true);
+	q.prepare("SELECT Errors.id FROM Errors "
+			"JOIN Files ON Files.id=Errors.file "
+			"JOIN Repos ON Repos.id=Files.repo "
+			"JOIN Messages ON Messages.id=Errors.message "
+			"WHERE Repos.repo||'/'||Files.file GLOB ? "
+			"AND Messages.message GLOB ?");
+	q.addBindValue(globPattern(pathPattern));
+	q.addBindValue(globPattern(messagePattern));
+	if (!q.exec())
+	{
+		qWarning() << "Matching Errors:" << q.lastError().text();
+		return 0;
+	}
+
+	QList<int> errorIds;
+	while (q.next())
+		errorIds << q.value(0).toInt();
+	q.finish();
+
+	return annotateErrors(errorIds, notes);
+}
+
+/**********************************************************************\
+ * PUBLIC SLOTS
+\**********************************************************************/
+void
+Database::removeSession(const QString& session)
+{
+	int sessionId = _sessionMap[session];
+
+	QSqlQuery q(_db);
+	q.exec("BEGIN");
+
+	QList<int> aliases = _aliasMap.keys(sessionId);
+	QList<int> dependents = _baseMap.keys(sessionId);
+	if (_aliasMap.contains(sessionId))
+	{
+		// Aliases don't own any rows
+		_aliasMap.remove(sessionId);
+	}
+	else if (!aliases.isEmpty())
+	{
+		// Hand this session's data over to its first alias
+		int heir = aliases.takeFirst();
+
+		q.prepare("UPDATE Main SET session=? WHERE session=?");
+		q.addBindValue(heir);
+		q.addBindValue(sessionId);
+		if (!q.exec())
+			qWarning() << "Moving Session rows in Main:" << q.lastError().text();
+
+		q.prepare("UPDATE Removed SET session=? WHERE session=?");
+		q.addBindValue(heir);
+		q.addBindValue(sessionId);
+		if (!q.exec())
+			qWarning() << "Moving Session rows in Removed:" << q.lastError().text();
+
+		int baseId = _baseMap[sessionId];
+		q.prepare("UPDATE Sessions SET alias=NULL,base=? WHERE id=?");
+		q.addBindValue(baseId != 0 ? QVariant(baseId) : QVariant());
+		q.addBindValue(heir);
+		if (!q.exec())
+			qWarning() << "Promoting Session alias:" << q.lastError().text();
+
+		q.prepare("UPDATE Sessions SET alias=? WHERE alias=?");
+		q.addBindValue(heir);
+		q.addBindValue(sessionId);
+		if (!q.exec())
+			qWarning() << "Redirecting Session aliases:" << q.lastError().text();
+
+		q.prepare("UPDATE Sessions SET base=? WHERE base=?");
+		q.addBindValue(heir);
+		q.addBindValue(sessionId);
+		if (!q.exec())
+			qWarning() << "Redirecting Session bases:" << q.lastError().text();
+
+		_aliasMap.remove(heir);
+		for (int alias : aliases)
+			_aliasMap[alias] = heir;
+		for (int dependent : dependents)
+			_baseMap[dependent] = heir;
+		_baseMap[heir] = baseId;
+
+		quint64 hash = _hashMap.key(sessionId);
+		if (hash != 0)
+			_hashMap[hash] = heir;
+	}
+	else if (!dependents.isEmpty())
+	{
+		// Sessions which are stored as deltas against this one must be re-encoded.
+		// The first one becomes the new full snapshot for the rest.
+		QList<QVector<ErrorLine>> dependentRows;
+		for (int dependent : dependents)
+			dependentRows << readRows(dependent);
+
+		int newBase = dependents.first();
+		for (int i = 0; i < dependents.size(); ++i)
+		{
+			q.prepare("DELETE FROM Main WHERE session=?");
+			q.addBindValue(dependents[i]);
+			if (!q.exec())
+				qWarning() << "Re-encoding Session in Main:" << q.lastError().text();
+
+			q.prepare("DELETE FROM Removed WHERE session=?");
+			q.addBindValue(dependents[i]);
+			if (!q.exec())
+				qWarning() << "Re-encoding Session in Removed:" << q.lastError().text();
+
+			writeRows(dependents[i], (i == 0) ? 0 : newBase, dependentRows[i]);
+		}
+	}
+
+	q.prepare("DELETE FROM Removed WHERE session=?");
+	q.addBindValue(sessionId);
+	if (!q.exec())
+		qWarning() << "Deleting Session from Removed:" << q.lastError().text();
+
+	q.prepare("DELETE FROM Unrecorded WHERE session=?");
+	q.addBindValue(sessionId);
+	if (!q.exec())
+		qWarning() << "Deleting Session from Unrecorded:" << q.lastError().text();
+
+	q.prepare("DELETE FROM Main WHERE session=?");
+	q.addBindValue(sessionId);
+	if (!q.exec())
+		qWarning() << "Deleting Session from Main:" << q.lastError().text();
+
+	q.prepare("DELETE FROM Sessions WHERE id=?");
+	q.addBindValue(sessionId);
+	if (!q.exec())
+		qWarning() << "Deleting Session:" << q.lastError().text();
+
+	q.exec("COMMIT");
+
+	if (session == _fullSession)
+		_fullSession.clear();
+
+	// Re-encoded sessions get new row IDs
+	_tableCache.clear();
+	_summaryModel->clearCache();
+
+	_sessionMap.remove(session);
+	_baseMap.remove(sessionId);
+	_hashMap.remove(_hashMap.key(sessionId));
+
+	// Loads that are in flight might have read the old rows, so queue them
+	// again. Loads of the deleted session's data are dropped.
+	QHash<int, PendingLoad> pendingLoads = _pendingLoads;
+	_pendingLoads.clear();
+	_loader->nextGeneration(SessionLoader::Prefetch);
+	for (auto it = pendingLoads.constBegin(); it != pendingLoads.constEnd(); ++it)
+	{
+		if (it->sessionId != sessionId)
+			requestTable(it.key(), it->sessionId);
+		else
+		{
+			_loader->nextGeneration(it.key());
+			if (it.key() == SessionLoader::FullTable)
+				_fullSession.clear();
+		}
+	}
+
+	refreshSessionList();
+}
+
+/**********************************************************************\
+ * PRIVATE SLOTS
+\**********************************************************************/
+void
+Database::setTable(int target, int generation, int sessionId, const QSharedPointer<SessionTable>& table)
+{
+	// Ignore loads that finished just before being superseded. They might
+	// have read rows that have changed since (see removeSession()).
+	if (generation != _loader->generation(target))
+		return;
+
+	// Rough estimate: the strings are mostly shared between rows
+	int cost = qMax(1, int(table->size() * (sizeof(SessionRow) + 32) / 1024));
+	_tableCache.insert(_aliasMap.value(sessionId, sessionId), new QSharedPointer<SessionTable>(table), cost);
+
+	// Hand the table to every target that shares this load
+	bool diffChanged = false;
+	for (auto it = _pendingLoads.begin(); it != _pendingLoads.end();)
+	{
+		if (it->owner != target)
+		{
+			++it;
+			continue;
+		}
+
+		switch (it.key())
+		{
+		case SessionLoader::FullTable:
+			_fullModel->setTable(table);
+			break;
+		case SessionLoader::DiffTable_L:
+			_diffTables[0] = table;
+			diffChanged = true;
+			break;
+		case SessionLoader::DiffTable_R:
+			_diffTables[1] = table;
+			diffChanged = true;
+			break;
+		}
+		it = _pendingLoads.erase(it);
+	}
+
+	if (diffChanged)
+		updateDiffModels();
+}
+
+// The targets that shared the load keep their old tables. Forget the full
+// session, so that selecting it again retries the load.
+void
+Database::dropFailedLoad(int target, int generation)
+{
+	if (generation != _loader->generation(target))
+		return;
+
+	// The diff is still shown, just without the similar errors
+	if (target == SessionLoader::Signatures)
+	{
+		_unmatchedDiffs[0].clear();
+		_unmatchedDiffs[1].clear();
+		return;
+	}
+
+	// The previous matrix stays
+	if (target == SessionLoader::Matrix)
+		return;
+
+	for (auto it = _pendingLoads.begin(); it != _pendingLoads.end();)
+	{
+		if (it->owner != target)
+		{
+			++it;
+			continue;
+		}
+
+		if (it.key() == SessionLoader::FullTable)
+			_fullSession.clear();
+		it = _pendingLoads.erase(it);
+	}
+}
+
+void
+Database::setSignatures(int generation, const QHash<int, QByteArray>& signatures)
+{
+	if (generation != _loader->generation(SessionLoader::Signatures) || !_fuzzyMatching
+			|| !_unmatchedDiffs[0] || !_unmatchedDiffs[1])
+	{
+		return;
+	}
+
+	matchSimilarErrors(_unmatchedDiffs, signatures);
+	_diffModel_L->setTable(_unmatchedDiffs[0]);
+	_diffModel_R->setTable(_unmatchedDiffs[1]);
+
+	_unmatchedDiffs[0].clear();
+	_unmatchedDiffs[1].clear();
+}
+
+void
+Database::setMatrix(int generation, const SessionMatrix& matrix)
+{
+	if (generation == _loader->generation(SessionLoader::Matrix))
+		_matrixModel->setMatrix(matrix);
+}
+
+void
+Database::updateNotes(int errorId, const QString& notes)
+{
+	refreshNotes(QSet<int>() << errorId, notes);
+}
+
+void
+Database::prefetchNeighbours()
+{
+	QStringList sessions = _sessionListModel->stringList();
+	QStringList neighbours;
+	for (const QString& session : {_fullSession, _diffSession})
+	{
+		int i = sessions.indexOf(session);
+		if (i < 0)
+			continue;
+
+		if (i > 0)
+			neighbours << sessions[i - 1];
+		if (i + 1 < sessions.size())
+			neighbours << sessions[i + 1];
+	}
+
+	for (const QString& session : neighbours)
+	{
+		int sessionId = _sessionMap[session];
+		if (!_tableCache.contains(_aliasMap.value(sessionId, sessionId)))
+			requestTable(SessionLoader::Prefetch, sessionId);
+	}
+}
+
+/**********************************************************************\
+ * PRIVATE
+\**********************************************************************/
+void
+Database::addColumn(const QString& table, const QString& column, const QString& type)
+{
+	QSqlQuery q(_db);
+	if (!q.exec("PRAGMA table_info(" + table + ')'))
+		qWarning() << "Reading columns of" << table << ':' << q.lastError().text();
+	while (q.next())
+	{
+		if (q.value("name").toString() == column)
+			return;
+	}
+
+	if (!q.exec(QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, type)))
+		qWarning() << "Adding column" << column << "to" << table << ':' << q.lastError().text();
+}
+
+// Stores the classifier's categories, and classifies the messages that
+// haven't been classified yet. Everything is reclassified if the rules have
+// changed since the last run.
+void
+Database::classifyMessages()
+{
+	QStringList names = MessageClassifier::categoryNames();
+	qint64 fingerprint = qint64(MessageClassifier::fingerprint());
+
+	QSqlQuery q(_db);
+	QVariant storedFingerprint;
+	if (!q.exec("SELECT value FROM Settings WHERE name='classifier'"))
+		qWarning() << "Loading Settings:" << q.lastError().text();
+	if (q.next())
+		storedFingerprint = q.value(0);
+
+	q.exec("BEGIN");
+	if (storedFingerprint.isNull() || storedFingerprint.toLongLong() != fingerprint)
+	{
+		q.exec("UPDATE Messages SET category=NULL");
+		q.exec("DELETE FROM Categories");
+
+		q.prepare("INSERT INTO Categories(id,name) VALUES(?,?)");
+		for (int c = 0; c < names.size(); ++c)
+		{
+			q.addBindValue(c);
+			q.addBindValue(names[c]);
+			if (!q.exec())
+				qWarning() << "Inserting into Categories:" << q.lastError().text();
+		}
+
+		q.prepare("INSERT OR REPLACE INTO Settings(name,value) VALUES('classifier',?)");
+		q.addBindValue(fingerprint);
+		if (!q.exec())
+			qWarning() << "Storing the classifier's fingerprint:" << q.lastError().text();
+	}
+
+	QList<QPair<int, int>> categories; // Messages.id, category
+	if (!q.exec("SELECT id,message FROM Messages WHERE category IS NULL"))
+		qWarning() << "Loading Messages:" << q.lastError().text();
+	while (q.next())
+	{
+		QString message = q.value(1).toString();
+		categories << qMakePair(q.value(0).toInt(), MessageClassifier::instance().classify(QStringRef(&message)));
+	}
+
+	q.prepare("UPDATE Messages SET category=? WHERE id=?");
+	for (const auto& category : categories)
+	{
+		q.addBindValue(category.second);
+		q.addBindValue(category.first);
+		if (!q.exec())
+		{
+			qWarning() << "Classifying Messages:" << q.lastError().text();
+			break;
+		}
+	}
+	q.exec("COMMIT");
+}
+
+int
+Database::insert(const QString& table, QList<QPair<QString, QVariant>> fields)
+{
+	QString columns;
+	QString values;
+	for (int i = 0; i < fields.size(); ++i)
+	{
+		columns += fields[i].first + ',';
+		values  += "?,";
+	}
+	columns.chop(1); // Remove trailing ','
+	values.chop(1);
+
+	QString query = QString("INSERT INTO %1(%2) VALUES(%3)")
+			.arg(table).arg(columns).arg(values);
+
+	QSqlQuery q(_db);
+	q.prepare(query);
+	for (int i = 0; i < fields.size(); ++i)
+		q.addBindValue(fields[i].second);
+
+	if (!q.exec())
+	{
+		qWarning() << "Inserting into" << table << ':' << q.lastError().text();
+		return -1;
+	}
+	return q.lastInsertId().toInt();
+}
+
+// Returns a SELECT statement that produces the (id, error, line) rows of a
+// session. Delta-encoded sessions are reconstructed from their base snapshot.
+QString
+Database::sessionRows(int sessionId) const
+{
+	sessionId = _aliasMap.value(sessionId, sessionId);
+	QString ownRows = QString("SELECT id,error,line FROM Main WHERE session=%1").arg(sessionId);
+
+	int baseId = _baseMap.value(sessionId);
+	if (baseId == 0)
+		return ownRows;
+
+	return ownRows + QString(
+			" UNION ALL "
+			"SELECT id,error,line FROM Main WHERE session=%1 "
+			"AND NOT EXISTS (SELECT 1 FROM Removed WHERE Removed.session=%2 "
+			"AND Removed.error=Main.error AND Removed.line=Main.line)")
+			.arg(baseId).arg(sessionId);
+}
+
+QVector<Database::ErrorLine>
+Database::readRows(int sessionId) const
+{
+	QVector<ErrorLine> rows;
+
+	QSqlQuery q(_db);
+	q.setForwardOnly(true);
+	if (!q.exec("SELECT error,line FROM (" + sessionRows(sessionId) + ')'))
+		qWarning() << "Reading Session rows:" << q.lastError().text();
+	while (q.next())
+		rows << ErrorLine(q.value(0).toInt(), q.value(1).toInt());
+
+	return rows;
+}
+
+// Returns the most recent full snapshot that can still accept new deltas,
+// or 0 if the next session should be stored in full
+int
+Database::latestSnapshot() const
+{
+	if (_snapshotInterval <= 1)
+		return 0;
+
+	int snapshotId = 0;
+	for (auto it = _baseMap.constBegin(); it != _baseMap.constEnd(); ++it)
+	{
+		if (it.value() == 0)
+			snapshotId = qMax(snapshotId, it.key());
+	}
+
+	if (snapshotId == 0 || _baseMap.keys(snapshotId).size() + 1 >= _snapshotInterval)
+		return 0;
+	return snapshotId;
+}
+
+// Stores the rows of a session, either in full or as a delta against baseId.
+// Must be called inside a transaction.
+void
+Database::writeRows(int sessionId, int baseId, const QVector<ErrorLine>& rows)
+{
+	QVector<ErrorLine> added = rows;
+	QVector<ErrorLine> removed;
+
+	if (baseId != 0)
+	{
+		QHash<ErrorLine, int> baseCounts;
+		for (const ErrorLine& row : readRows(baseId))
+			++baseCounts[row];
+
+		QHash<ErrorLine, int> newCounts;
+		for (const ErrorLine& row : rows)
+			++newCounts[row];
+
+		// A removed (error, line) pair hides all of its copies in the base
+		// session, so pairs that occur a different number of times are
+		// removed and then re-added in full
+		added.clear();
+		for (const ErrorLine& row : rows)
+		{
+			if (newCounts[row] != baseCounts.value(row))
+				added << row;
+		}
+		for (auto it = baseCounts.constBegin(); it != baseCounts.constEnd(); ++it)
+		{
+			if (newCounts.value(it.key()) != it.value())
+				removed << it.key();
+		}
+
+		// Not worth it if the sessions are too different
+		if (added.size() + removed.size() > rows.size()/2)
+		{
+			baseId = 0;
+			added = rows;
+			removed.clear();
+		}
+	}
+
+	QSqlQuery q(_db);
+	q.prepare("INSERT INTO Main(session,error,line) VALUES(?,?,?)");
+	for (const ErrorLine& row : added)
+	{
+		q.addBindValue(sessionId);
+		q.addBindValue(row.first);
+		q.addBindValue(row.second);
+		if (!q.exec())
+			qWarning() << "Inserting into Main:" << q.lastError().text();
+	}
+
+	q.prepare("INSERT INTO Removed(session,error,line) VALUES(?,?,?)");
+	for (const ErrorLine& row : removed)
+	{
+		q.addBindValue(sessionId);
+		q.addBindValue(row.first);
+		q.addBindValue(row.second);
+		if (!q.exec())
+			qWarning() << "Inserting into Removed:" << q.lastError().text();
+	}
+
+	q.prepare("UPDATE Sessions SET base=? WHERE id=?");
+	q.addBindValue(baseId != 0 ? QVariant(baseId) : QVariant());
+	q.addBindValue(sessionId);
+	if (!q.exec())
+		qWarning() << "Updating Session base:" << q.lastError().text();
+
+	_baseMap[sessionId] = baseId;
+}
+
+void
+Database::writeUnrecordedLines(int sessionId, const UnrecordedLines& lines)
+{
+	QSqlQuery q(_db);
+	q.prepare("INSERT INTO Unrecorded(session,category,count,samples) VALUES(?,?,?,?)");
+	for (int c = 0; c < UnrecordedLines::CategoryCount; ++c)
+	{
+		if (lines.count(c) == 0)
+			continue;
+
+		q.addBindValue(sessionId);
+		q.addBindValue(c);
+		q.addBindValue(lines.count(c));
+		q.addBindValue(lines.samples(c).join('\n'));
+		if (!q.exec())
+			qWarning() << "Inserting into Unrecorded:" << q.lastError().text();
+	}
+}
+
+// Loads the session for the target, unless another target is already
+// waiting for the same session. Prefetches are never shared.
+void
+Database::requestTable(int target, int sessionId)
+{
+	if (target == SessionLoader::Prefetch)
+	{
+		queueLoad(target, sessionId);
+		return;
+	}
+
+	cancelLoad(target);
+
+	int dataId = _aliasMap.value(sessionId, sessionId);
+	for (auto it = _pendingLoads.constBegin(); it != _pendingLoads.constEnd(); ++it)
+	{
+		if (it->sessionId == dataId && it->owner == it.key())
+		{
+			_pendingLoads[target] = {dataId, it.key()};
+			return;
+		}
+	}
+
+	_pendingLoads[target] = {dataId, target};
+	queueLoad(target, sessionId);
+}
+
+void
+Database::queueLoad(int target, int sessionId)
+{
+	// Prefetching must not hold up the tables that the user is waiting for
+	if (target != SessionLoader::Prefetch)
+		_loader->nextGeneration(SessionLoader::Prefetch);
+
+	int generation = (target == SessionLoader::Prefetch)
+			? _loader->generation(target)
+			: _loader->nextGeneration(target);
+
+	QMetaObject::invokeMethod(_loader, "load", Qt::QueuedConnection,
+			Q_ARG(int, target),
+			Q_ARG(int, generation),
+			Q_ARG(int, sessionId),
+			Q_ARG(QString, coreModelSelection(sessionRows(sessionId))));
+}
+
+// Cancels the target's pending load. If other targets share it, the first of
+// them queues the load again.
+void
+Database::cancelLoad(int target)
+{
+	_loader->nextGeneration(target);
+	if (!_pendingLoads.contains(target))
+		return;
+
+	PendingLoad load = _pendingLoads.take(target);
+	if (load.owner != target)
+		return;
+
+	int heir = -1;
+	for (auto it = _pendingLoads.begin(); it != _pendingLoads.end(); ++it)
+	{
+		if (it->owner != target)
+			continue;
+
+		if (heir < 0)
+		{
+			heir = it.key();
+			queueLoad(heir, load.sessionId);
+		}
+		it->owner = heir;
+	}
+}
+
+QSharedPointer<SessionTable>
+Database::cachedTable(int sessionId)
+{
+	auto table = _tableCache.object(_aliasMap.value(sessionId, sessionId));
+	return table ? *table : QSharedPointer<SessionTable>();
+}
+
+// Shows the errors that only appear in one of the sessions
+void
+Database::updateDiffModels()
+{
+	if (!_diffTables[0] || !_diffTables[1])
+		return;
+
+	QSet<int> errors[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		errors[i].reserve(_diffTables[i]->size());
+		for (const SessionRow& row : *_diffTables[i])
+			errors[i] << row.error;
+	}
+
+	QSharedPointer<SessionTable> diffs[2] = {
+		QSharedPointer<SessionTable>(new SessionTable),
+		QSharedPointer<SessionTable>(new SessionTable)
+	};
+	for (int i = 0; i < 2; ++i)
+	{
+		for (const SessionRow& row : *_diffTables[i])
+		{
+			if (!errors[1 - i].contains(row.error))
+				diffs[i]->append(row);
+		}
+	}
+
+	_diffModel_L->setTable(diffs[0]);
+	_diffModel_R->setTable(diffs[1]);
+
+	// Only the cache needs to keep the full tables
+	_diffTables[0].clear();
+	_diffTables[1].clear();
+
+	// Similar errors are moved out of the diff once their signatures arrive
+	if (_fuzzyMatching)
+	{
+		_matchModel->setMatches(QVector<ErrorMatch>());
+
+		QSet<int> errorIds;
+		for (int i = 0; i < 2; ++i)
+		{
+			_unmatchedDiffs[i] = diffs[i];
+			for (const SessionRow& row : *diffs[i])
+				errorIds << row.error;
+		}
+
+		QMetaObject::invokeMethod(_loader, "loadSignatures", Qt::QueuedConnection,
+				Q_ARG(int, _loader->nextGeneration(SessionLoader::Signatures)),
+				Q_ARG(QVector<int>, errorIds.toList().toVector()));
+	}
+}
+
+// Moves the pairs of similar errors from the diff tables to the match model.
+// Each error is matched once, using its first row.
+void
+Database::matchSimilarErrors(QSharedPointer<SessionTable>* diffs, const QHash<int, QByteArray>& signatures)
+{
+	QVector<int> firstRows[2];
+	QVector<QByteArray> diffSignatures[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		QSet<int> seen;
+		for (int row = 0; row < diffs[i]->size(); ++row)
+		{
+			int errorId = diffs[i]->at(row).error;
+			if (seen.contains(errorId))
+				continue;
+
+			seen << errorId;
+			firstRows[i] << row;
+			diffSignatures[i] << signatures.value(errorId);
+		}
+	}
+
+	QVector<ErrorMatch> matches;
+	QSet<int> matchedErrors[2];
+	for (const MinHash::Match& match : MinHash::matchPairs(diffSignatures[0], diffSignatures[1], fuzzyMatchThreshold))
+	{
+		ErrorMatch errorMatch;
+		errorMatch.left = diffs[0]->at(firstRows[0][match.left]);
+		errorMatch.right = diffs[1]->at(firstRows[1][match.right]);
+		errorMatch.similarity = match.similarity;
+		matches << errorMatch;
+
+		matchedErrors[0] << errorMatch.left.error;
+		matchedErrors[1] << errorMatch.right.error;
+	}
+	_matchModel->setMatches(matches);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (matchedErrors[i].isEmpty())
+			continue;
+
+		QSharedPointer<SessionTable> unmatched(new SessionTable);
+		for (const SessionRow& row : *diffs[i])
+		{
+			if (!matchedErrors[i].contains(row.error))
+				unmatched->append(row);
+		}
+		diffs[i] = unmatched;
+	}
+}
+
+// Notes apply to all sessions, so update every loaded row of these errors
+void
+Database::refreshNotes(const QSet<int>& errorIds, const QString& notes)
+{
+	if (errorIds.isEmpty())
+		return;
+
+	QList<QSharedPointer<SessionTable>> tables;
+	for (int key : _tableCache.keys())
+		tables << *_tableCache.object(key);
+	tables << _diffTables[0] << _diffTables[1] << _unmatchedDiffs[0] << _unmatchedDiffs[1];
+
+	for (const QSharedPointer<SessionTable>& table : tables)
+	{
+		if (!table)
+			continue;
+
+		for (SessionRow& row : *table)
+		{
+			if (errorIds.contains(row.error))
+				row.notes = notes;
+		}
+	}
+
+	for (DatabaseModel* model : {_fullModel, _diffModel_L, _diffModel_R})
+		model->updateNotes(errorIds, notes);
+}
+
+void
+Database::loadSessions()
+{
+	_sessionMap.clear();
+	_baseMap.clear();
+	_aliasMap.clear();
+	_hashMap.clear();
+
+	QSqlQuery q(_db);
+	if (!q.exec("SELECT id,timestamp,comments,base,alias,hash FROM Sessions"))
+		qWarning() << "Loading Sessions:" << q.lastError().text();
+	while (q.next())
+	{
+		QString entry = simplifyEntry(q.value("timestamp").toDateTime(),
+				q.value("comments").toString());
+
+		int id = q.value("id").toInt();
+		_sessionMap[entry] = id;
+		if (q.value("alias").toInt() != 0)
+			_aliasMap[id] = q.value("alias").toInt();
+		else
+		{
+			_baseMap[id] = q.value("base").toInt();
+
+			quint64 hash = q.value("hash").toLongLong();
+			if (hash != 0)
+				_hashMap[hash] = id;
+		}
+	}
+	refreshSessionList();
+}
+
+void
+Database::refreshSessionList()
+{
+	auto sessions = _sessionMap.keys();
+	std::sort(sessions.begin(), sessions.end());
+	std::reverse(sessions.begin(), sessions.end());
+	_sessionListModel->setStringList(sessions);
+
+	// TODO: Clear table models if session list changed
+}
+
+//======================================================================
+// DATABASEMODEL
+//======================================================================
+void
+DatabaseModel::setTable(const QSharedPointer<SessionTable>& table)
+{
+	beginResetModel();
+	_table = table;
+	endResetModel();
+}
+
+int
+DatabaseModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.isValid() || !_table)
+		return 0;
+	return _table->size();
+}
+
+int
+DatabaseModel::columnCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return ColumnCount;
+}
+
+QVariant
+DatabaseModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid())
+		return QVariant();
+
+	const SessionRow& row = _table->at(index.row());
+	if (role == Database::ErrorIdRole)
+		return row.error;
+	if (role == Database::CategoryRole)
+		return row.category;
+	if (role != Qt::DisplayRole && role != Qt::EditRole)
+		return QVariant();
+
+	switch (index.column())
+	{
+	case IdColumn: return row.id;
+	case RepoColumn: return row.repo;
+	case FileColumn: return row.file;
+	case LineColumn: return row.line;
+	case MessageColumn: return row.message;
+	case CategoryColumn: return MessageClassifier::categoryName(row.category);
+	case NotesColumn: return row.notes;
+	}
+	return QVariant();
+}
+
+QVariant
+DatabaseModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QAbstractTableModel::headerData(section, orientation, role);
+
+	switch (section)
+	{
+	case IdColumn: return "id";
+	case RepoColumn: return "repo";
+	case FileColumn: return "file";
+	case LineColumn: return "line";
+	case MessageColumn: return "message";
+	case CategoryColumn: return "category";
+	case NotesColumn: return "notes";
+	}
+	return QVariant();
+}
+
+Qt::ItemFlags
+DatabaseModel::flags(const QModelIndex& index) const
+{
+	// Only notes can be updated manually
+	Qt::ItemFlags flags = QAbstractTableModel::flags(index);
+	if (index.column() == NotesColumn)
+		flags |= Qt::ItemIsEditable;
+
+	return flags;
+}
+
+bool
+DatabaseModel::setData(const QModelIndex& index, const QVariant& value, int /*role*/)
+{
+	// Only notes can be updated manually
+	if (!index.isValid() || index.column() != NotesColumn)
+		return false;
+
+	// Update error notes. Errors are considered identical if the same message
+	// originates from the same file
+	int errorId = _table->at(index.row()).error;
+
+	QSqlQuery q;
+	q.prepare("UPDATE Errors SET notes=? WHERE id=?");
+	q.addBindValue(value);
+	q.addBindValue(errorId);
+	if (!q.exec())
+		return false;
+
+	// The database updates all loaded rows, including this model's
+	emit notesEdited(errorId, value.toString());
+	return true;
+}
+
+// Update the rows in place, to maintain the views' sort order and scroll position
+void
+DatabaseModel::updateNotes(const QSet<int>& errorIds, const QString& notes)
+{
+	if (!_table)
+		return;
+
+	bool changed = false;
+	for (SessionRow& row : *_table)
+	{
+		if (errorIds.contains(row.error))
+		{
+			row.notes = notes;
+			changed = true;
+		}
+	}
+
+	if (changed)
+		emit dataChanged(index(0, NotesColumn), index(rowCount() - 1, NotesColumn));
+}
+
+//======================================================================
+// MATCHMODEL
+//======================================================================
+void
+MatchModel::setMatches(const QVector<ErrorMatch>& matches)
+{
+	beginResetModel();
+	_matches = matches;
+	endResetModel();
+}
+
+int
+MatchModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return _matches.size();
+}
+
+int
+MatchModel::columnCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return ColumnCount;
+}
+
+QVariant
+MatchModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	const ErrorMatch& match = _matches[index.row()];
+	switch (index.column())
+	{
+	case SimilarityColumn: return qRound(match.similarity * 100);
+	case FileColumn_L: return match.left.repo + '/' + match.left.file;
+	case LineColumn_L: return match.left.line;
+	case MessageColumn_L: return match.left.message;
+	case FileColumn_R: return match.right.repo + '/' + match.right.file;
+	case LineColumn_R: return match.right.line;
+	case MessageColumn_R: return match.right.message;
+	}
+	return QVariant();
+}
+
+QVariant
+MatchModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QAbstractTableModel::headerData(section, orientation, role);
+
+	switch (section)
+	{
+	case SimilarityColumn: return "similarity (%)";
+	case FileColumn_L: return "left file";
+	case LineColumn_L: return "left line";
+	case MessageColumn_L: return "left message";
+	case FileColumn_R: return "right file";
+	case LineColumn_R: return "right line";
+	case MessageColumn_R: return "right message";
+	}
+	return QVariant();
+}
+
+//======================================================================
+// MATRIXMODEL
+//======================================================================
+MatrixModel::MatrixModel(QObject* parent)
+	: QAbstractTableModel(parent)
+	, _wordsPerError(1)
+	, _filter(Database::AllErrors)
+	, _n(1)
+{}
+
+void
+MatrixModel::setMatrix(const SessionMatrix& matrix)
+{
+	beginResetModel();
+
+	_sessions = matrix.sessions;
+	_errors = matrix.errors;
+	_bits = matrix.bits;
+	_wordsPerError = matrix.wordsPerError;
+
+	_counts.fill(0, _errors.size());
+	for (int e = 0; e < _errors.size(); ++e)
+	{
+		for (int w = 0; w < _wordsPerError; ++w)
+		{
+			for (quint64 word = _bits[e*_wordsPerError + w]; word != 0; word &= word - 1)
+				++_counts[e];
+		}
+	}
+
+	updateRows();
+	endResetModel();
+}
+
+void
+MatrixModel::setPresenceFilter(int filter, int n)
+{
+	beginResetModel();
+	_filter = filter;
+	_n = qMax(1, n);
+	updateRows();
+	endResetModel();
+}
+
+int
+MatrixModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return _rows.size();
+}
+
+int
+MatrixModel::columnCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return SessionColumn + _sessions.size();
+}
+
+QVariant
+MatrixModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid())
+		return QVariant();
+
+	int e = _rows[index.row()];
+	if (index.column() >= SessionColumn)
+	{
+		bool present = isPresent(e, index.column() - SessionColumn);
+		if (role == Qt::DisplayRole)
+			return present ? "X" : "";
+		if (role == Qt::TextAlignmentRole)
+			return Qt::AlignCenter;
+		return QVariant();
+	}
+
+	if (role != Qt::DisplayRole)
+		return QVariant();
+
+	const Error& error = _errors[e];
+	switch (index.column())
+	{
+	case RepoColumn: return error.repo;
+	case FileColumn: return error.file;
+	case MessageColumn: return error.message;
+	case CountColumn: return _counts[e];
+	}
+	return QVariant();
+}
+
+QVariant
+MatrixModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QAbstractTableModel::headerData(section, orientation, role);
+
+	switch (section)
+	{
+	case RepoColumn: return "repo";
+	case FileColumn: return "file";
+	case MessageColumn: return "message";
+	case CountColumn: return "sessions";
+	}
+	return _sessions.value(section - SessionColumn);
+}
+
+// The sessions are in chronological order, so the "last" sessions are at the end
+bool
+MatrixModel::isAccepted(int error) const
+{
+	int sessionCount = _sessions.size();
+	int n = qMin(_n, sessionCount);
+
+	switch (_filter)
+	{
+	case Database::InAllSessions:
+		return _counts[error] == sessionCount;
+
+	case Database::InSomeSessions:
+		return _counts[error] < sessionCount;
+
+	case Database::NewInLastSessions:
+		if (!isPresent(error, sessionCount - 1))
+			return false;
+		for (int s = 0; s < sessionCount - n; ++s)
+		{
+			if (isPresent(error, s))
+				return false;
+		}
+		return true;
+
+	case Database::FixedInLastSessions:
+		for (int s = sessionCount - n; s < sessionCount; ++s)
+		{
+			if (isPresent(error, s))
+				return false;
+		}
+		return true;
+
+	case Database::IntermittentErrors:
+	{
+		// Look for present -> absent -> present
+		bool seen = false;
+		bool gone = false;
+		for (int s = 0; s < sessionCount; ++s)
+		{
+			bool present = isPresent(error, s);
+			if (present && gone)
+				return true;
+			if (present)
+				seen = true;
+			else if (seen)
+				gone = true;
+		}
+		return false;
+	}
+
+	default:
+		return true;
+	}
+}
+
+void
+MatrixModel::updateRows()
+{
+	_rows.clear();
+	for (int e = 0; e < _errors.size(); ++e)
+	{
+		if (isAccepted(e))
+			_rows << e;
+	}
+}
+
+//======================================================================
+// AGGREGATEMODEL
+//======================================================================
+AggregateModel::AggregateModel(QObject* parent)
+	: QAbstractItemModel(parent)
+{
+	setRowSelections(QString(), QStringList(), QStringList());
+}
+
+void
+AggregateModel::setRowSelections(const QString& cacheKey, const QStringList& rowSelections, const QStringList& countLabels)
+{
+	beginResetModel();
+
+	_cacheKey = cacheKey;
+	_rowSelections = rowSelections;
+	_countLabels = countLabels;
+
+	Node root;
+	root.parent = -1;
+	root.row = 0;
+	root.depth = RootDepth;
+	root.fetched = rowSelections.isEmpty();
+	root.group.key = 0;
+
+	_nodes.clear();
+	_nodes << root;
+
+	endResetModel();
+}
+
+QModelIndex
+AggregateModel::index(int row, int column, const QModelIndex& parent) const
+{
+	if (!hasIndex(row, column, parent))
+		return QModelIndex();
+
+	return createIndex(row, column, quintptr(_nodes[nodeIndex(parent)].children[row]));
+}
+
+QModelIndex
+AggregateModel::parent(const QModelIndex& index) const
+{
+	if (!index.isValid())
+		return QModelIndex();
+
+	int parentNode = _nodes[nodeIndex(index)].parent;
+	if (parentNode <= 0)
+		return QModelIndex();
+
+	return createIndex(_nodes[parentNode].row, 0, quintptr(parentNode));
+}
+
+int
+AggregateModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.column() > 0)
+		return 0;
+	return _nodes[nodeIndex(parent)].children.size();
+}
+
+int
+AggregateModel::columnCount(const QModelIndex& /*parent*/) const
+{
+	return 1 + _countLabels.size();
+}
+
+bool
+AggregateModel::hasChildren(const QModelIndex& parent) const
+{
+	if (parent.column() > 0)
+		return false;
+
+	const Node& node = _nodes[nodeIndex(parent)];
+	if (!node.fetched)
+		return node.depth < MessageDepth;
+	return !node.children.isEmpty();
+}
+
+QVariant
+AggregateModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	const Group& group = _nodes[nodeIndex(index)].group;
+	if (index.column() == 0)
+		return group.name;
+	return group.counts[index.column() - 1];
+}
+
+QVariant
+AggregateModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QAbstractItemModel::headerData(section, orientation, role);
+
+	if (section == 0)
+		return "Repo / File / Message";
+	return _countLabels.value(section - 1);
+}
+
+bool
+AggregateModel::canFetchMore(const QModelIndex& parent) const
+{
+	if (parent.column() > 0)
+		return false;
+
+	const Node& node = _nodes[nodeIndex(parent)];
+	return !node.fetched && node.depth < MessageDepth;
+}
+
+void
+AggregateModel::fetchMore(const QModelIndex& parent)
+{
+	if (!canFetchMore(parent))
+		return;
+
+	int parentNode = nodeIndex(parent);
+	int depth = _nodes[parentNode].depth + 1;
+
+	QString key = QString("%1/%2/%3").arg(_cacheKey).arg(depth).arg(_nodes[parentNode].group.key);
+	if (!_cache.contains(key))
+		_cache[key] = queryGroups(depth, _nodes[parentNode].group.key);
+	const QVector<Group>& groups = _cache[key];
+
+	_nodes[parentNode].fetched = true;
+	if (groups.isEmpty())
+		return;
+
+	beginInsertRows(parent, 0, groups.size() - 1);
+	for (int i = 0; i < groups.size(); ++i)
+	{
+		Node node;
+		node.parent = parentNode;
+		node.row = i;
+		node.depth = depth;
+		node.fetched = false;
+		node.group = groups[i];
+
+		_nodes[parentNode].children << _nodes.size();
+		_nodes << node;
+	}
+	endInsertRows();
+}
+
+// Counts the rows of each row selection, grouped by the IDs at the given depth
+QVector<AggregateModel::Group>
+AggregateModel::queryGroups(int depth, int parentKey) const
+{
+	QString groupSelection;
+	switch (depth)
+	{
+	case RepoDepth:
+		groupSelection =
+				"SELECT Files.repo,Repos.repo,COUNT(*) FROM (%1) AS Main "
+				"JOIN Errors ON Errors.id=Main.error "
+				"JOIN Files ON Files.id=Errors.file "
+				"JOIN Repos ON Repos.id=Files.repo "
+				"GROUP BY Files.repo";
+		break;
+	case FileDepth:
+		groupSelection =
+				"SELECT Errors.file,Files.file,COUNT(*) FROM (%1) AS Main "
+				"JOIN Errors ON Errors.id=Main.error "
+				"JOIN Files ON Files.id=Errors.file "
+				"WHERE Files.repo=? "
+				"GROUP BY Errors.file";
+		break;
+	case MessageDepth:
+		groupSelection =
+				"SELECT Errors.message,Messages.message,COUNT(*) FROM (%1) AS Main "
+				"JOIN Errors ON Errors.id=Main.error "
+				"JOIN Messages ON Messages.id=Errors.message "
+				"WHERE Errors.file=? "
+				"GROUP BY Errors.message";
+		break;
+	default:
+		return QVector<Group>();
+	}
+
+	// Merge the counts from all row selections
+	QMap<int, Group> groups;
+	for (int i = 0; i < _rowSelections.size(); ++i)
+	{
+		QSqlQuery q;
+		q.setForwardOnly(true);
+		q.prepare(groupSelection.arg(_rowSelections[i]));
+		if (depth != RepoDepth)
+			q.addBindValue(parentKey);
+		if (!q.exec())
+			qWarning() << "Aggregating Session:" << q.lastError().text();
+
+		while (q.next())
+		{
+			int key = q.value(0).toInt();
+			if (!groups.contains(key))
+			{
+				Group group;
+				group.key = key;
+				group.name = q.value(1).toString();
+				group.counts.fill(0, _rowSelections.size());
+				groups[key] = group;
+			}
+			groups[key].counts[i] = q.value(2).toInt();
+		}
+	}
+
+	return groups.values().toVector();
+}
+
+//======================================================================
+// SESSIONLOADER
+//======================================================================
+SessionLoader::~SessionLoader()
+{
+	if (_db.isValid())
+	{
+		QString connectionName = _db.connectionName();
+		_db.close();
+		_db = QSqlDatabase();
+		QSqlDatabase::removeDatabase(connectionName);
+	}
+}
+
+void
+SessionLoader::load(int target, int generation, int sessionId, const QString& query)
+{
+	if (isStale(target, generation))
+		return;
+
+	openConnection();
+	QSqlQuery q(_db);
+	q.setForwardOnly(true);
+	if (!q.exec(query))
+	{
+		qWarning() << "Loading Session:" << q.lastError().text();
+		emit failed(target, generation);
+		return;
+	}
+
+	QSharedPointer<SessionTable> table(new SessionTable);
+	if (!readSessionTable(q, table.data(), [=]() {return isStale(target, generation);}))
+		return;
+
+	emit loaded(target, generation, sessionId, table);
+}
+
+void
+SessionLoader::loadSignatures(int generation, const QVector<int>& errorIds)
+{
+	if (isStale(Signatures, generation))
+		return;
+
+	openConnection();
+	QSqlQuery q(_db);
+	q.setForwardOnly(true);
+
+	QHash<int, QByteArray> signatures;
+	QList<int> missing;
+	for (int start = 0; start < errorIds.size(); start += idBatchSize)
+	{
+		QString query =
+				"SELECT Errors.id,Errors.signature,Repos.repo,Files.file,Messages.message FROM Errors "
+				"JOIN Files ON Files.id=Errors.file "
+				"JOIN Repos ON Repos.id=Files.repo "
+				"JOIN Messages ON Messages.id=Errors.message "
+				"WHERE Errors.id IN (" + idList(errorIds.mid(start, idBatchSize)) + ')';
+		if (!q.exec(query))
+		{
+			qWarning() << "Loading Signatures:" << q.lastError().text();
+			emit failed(Signatures, generation);
+			return;
+		}
+
+		while (q.next())
+		{
+			int errorId = q.value(0).toInt();
+			QByteArray signature = q.value(1).toByteArray();
+			if (signature.size() != MinHash::SignatureSize)
+			{
+				signature = MinHash::signature(errorText(q.value(2).toString(),
+						q.value(3).toString(), q.value(4).toString()));
+				missing << errorId;
+			}
+			signatures[errorId] = signature;
+		}
+
+		if (isStale(Signatures, generation))
+			return;
+	}
+	q.finish();
+
+	if (!missing.isEmpty())
+	{
+		q.exec("BEGIN");
+		q.prepare("UPDATE Errors SET signature=? WHERE id=?");
+		for (int errorId : missing)
+		{
+			q.addBindValue(signatures[errorId]);
+			q.addBindValue(errorId);
+			if (!q.exec())
+			{
+				qWarning() << "Storing Signatures:" << q.lastError().text();
+				break;
+			}
+		}
+		q.exec("COMMIT");
+	}
+
+	emit signaturesLoaded(generation, signatures);
+}
+
+void
+SessionLoader::loadMatrix(int generation, const QStringList& sessions,
+		const QVector<int>& dataIds, const QVector<int>& baseIds)
+{
+	if (isStale(Matrix, generation))
+		return;
+
+	SessionMatrix matrix;
+	matrix.sessions = sessions;
+	matrix.wordsPerError = qMax(1, (sessions.size() + 63) / 64);
+	if (sessions.isEmpty())
+	{
+		emit matrixLoaded(generation, matrix);
+		return;
+	}
+	const int wordsPerError = matrix.wordsPerError;
+
+	// Map the stored rows to the columns. Deltas also contain the rows of
+	// their base (minus the Removed rows)
+	QMap<int, QVector<int>> columnsOf; // Session ID that owns the rows -> Columns
+	QMap<int, QVector<int>> deltasOf; // Base session ID -> Delta session IDs
+	for (int c = 0; c < sessions.size(); ++c)
+	{
+		columnsOf[dataIds[c]] << c;
+
+		int baseId = baseIds[c];
+		if (baseId != 0 && !deltasOf[baseId].contains(dataIds[c]))
+			deltasOf[baseId] << dataIds[c];
+	}
+
+	openConnection();
+	QSqlQuery q(_db);
+	q.setForwardOnly(true);
+
+	// The (error, line) pairs that each delta removed from its base
+	QHash<int, QSet<quint64>> removedRows;
+	QList<int> deltaIds;
+	for (const QVector<int>& deltas : deltasOf)
+		deltaIds << deltas.toList();
+	if (!deltaIds.isEmpty())
+	{
+		if (!q.exec("SELECT session,error,line FROM Removed WHERE session IN (" + idList(deltaIds) + ')'))
+		{
+			qWarning() << "Loading Removed rows:" << q.lastError().text();
+			emit failed(Matrix, generation);
+			return;
+		}
+		while (q.next())
+		{
+			quint64 key = (quint64(q.value(1).toUInt()) << 32) | q.value(2).toUInt();
+			removedRows[q.value(0).toInt()] << key;
+		}
+	}
+
+	// One pass over the rows of all sessions involved
+	QList<int> storageIds = columnsOf.keys();
+	for (int baseId : deltasOf.keys())
+	{
+		if (!storageIds.contains(baseId))
+			storageIds << baseId;
+	}
+
+	QHash<int, int> errorIndices; // Errors.id -> Index
+	QVector<int> errorIds;
+	QVector<quint64>& bits = matrix.bits;
+	auto setPresent = [&](int errorId, const QVector<int>& columns)
+	{
+		int e = errorIndices.value(errorId, -1);
+		if (e < 0)
+		{
+			e = errorIds.size();
+			errorIndices[errorId] = e;
+			errorIds << errorId;
+			bits.resize(bits.size() + wordsPerError);
+		}
+		for (int c : columns)
+			bits[e*wordsPerError + c/64] |= quint64(1) << (c%64);
+	};
+
+	QString mainQuery = "SELECT session,error,line FROM Main WHERE session IN (" + idList(storageIds) + ')';
+	if (!q.exec(mainQuery))
+	{
+		qWarning() << "Loading Sessions:" << q.lastError().text();
+		emit failed(Matrix, generation);
+		return;
+	}
+	for (int rowCount = 0; q.next(); ++rowCount)
+	{
+		// Check every 1024 rows
+		if ((rowCount & 0x3ff) == 0 && isStale(Matrix, generation))
+			return;
+
+		int sessionId = q.value(0).toInt();
+		int errorId = q.value(1).toInt();
+
+		auto columns = columnsOf.constFind(sessionId);
+		if (columns != columnsOf.constEnd())
+			setPresent(errorId, *columns);
+
+		auto deltas = deltasOf.constFind(sessionId);
+		if (deltas == deltasOf.constEnd())
+			continue;
+
+		quint64 key = (quint64(quint32(errorId)) << 32) | q.value(2).toUInt();
+		for (int deltaId : *deltas)
+		{
+			// Same as the NOT EXISTS clause in Database::sessionRows()
+			if (!removedRows.value(deltaId).contains(key))
+				setPresent(errorId, columnsOf[deltaId]);
+		}
+	}
+	q.finish();
+
+	// Describe the errors. Only the IDs that were found are looked up.
+	matrix.errors.resize(errorIds.size());
+	for (int start = 0; start < errorIds.size(); start += idBatchSize)
+	{
+		QString errorQuery =
+				"SELECT Errors.id,Repos.repo,Files.file,Messages.message FROM Errors "
+				"JOIN Files ON Files.id=Errors.file "
+				"JOIN Repos ON Repos.id=Files.repo "
+				"JOIN Messages ON Messages.id=Errors.message "
+				"WHERE Errors.id IN (" + idList(errorIds.mid(start, idBatchSize)) + ')';
+		if (!q.exec(errorQuery))
+		{
+			qWarning() << "Loading Errors:" << q.lastError().text();
+			emit failed(Matrix, generation);
+			return;
+		}
+		while (q.next())
+		{
+			int e = errorIndices.value(q.value(0).toInt(), -1);
+			if (e < 0)
+				continue;
+
+			SessionMatrix::Error& error = matrix.errors[e];
+			error.id = q.value(0).toInt();
+			error.repo = q.value(1).toString();
+			error.file = q.value(2).toString();
+			error.message = q.value(3).toString();
+		}
+
+		if (isStale(Matrix, generation))
+			return;
+	}
+
+	emit matrixLoaded(generation, matrix);
+}
+
+// The connection must be created in the thread that uses it
+void
+SessionLoader::openConnection()
+{
+	if (_db.isValid())
+		return;
 
-	return ok;
+	// Wait for the GUI's connection if it is writing
+	_db = QSqlDatabase::addDatabase("QSQLITE", "SessionLoader");
+	_db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+	_db.setDatabaseName(_sqliteFile);
+	_db.open();
 }
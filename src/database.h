@@ -6,53 +6,199 @@
 
 #include <QObject>
 #include <QStringListModel>
-#include <QSqlQueryModel>
+#include <QAbstractTableModel>
 #include <QSqlDatabase>
+#include <QSharedPointer>
 #include <QDateTime>
 #include <QMap>
+#include <QSet>
+#include <QHash>
+#include <QVector>
+#include <QCache>
+#include <QTimer>
+#include "parsedlog.h"
+#include "unrecordedlines.h"
 
-struct RawError
+struct Session
 {
+	QDateTime timestamp;
+	QString comments;
+	ParsedLog log;
+	UnrecordedLines unrecorded;
+};
+
+// A row of a loaded session. Strings are shared between rows.
+struct SessionRow
+{
+	int id;    // Main.id
+	int error; // Errors.id
 	QString repo;
 	QString file;
 	int line;
 	QString message;
+	int category; // Messages.category
+	QString notes;
 };
+typedef QVector<SessionRow> SessionTable;
+Q_DECLARE_METATYPE(QSharedPointer<SessionTable>)
 
-struct Session
+// Errors as rows, sessions as columns. See Database::setMatrixSessions()
+struct SessionMatrix
 {
-	QDateTime timestamp;
-	QString comments;
-	QList<QSharedPointer<RawError>> errors;
+	struct Error
+	{
+		int id; // Errors.id
+		QString repo;
+		QString file;
+		QString message;
+	};
+
+	QStringList sessions;
+	QVector<Error> errors;
+
+	// wordsPerError words for each error. Bit c is set if the error is
+	// present in sessions[c].
+	QVector<quint64> bits;
+	int wordsPerError;
 };
+Q_DECLARE_METATYPE(SessionMatrix)
+
+class DatabaseModel;
+class MatchModel;
+class MatrixModel;
+class AggregateModel;
+class SessionLoader;
+class QThread;
 
 class Database : public QObject
 {
 	Q_OBJECT
 
 public:
-	Database(const QString& sqliteFile, QObject* parent = nullptr);
-	~Database() { _db.close(); }
+	// Every column of the session models (full and diff) also provides
+	// the Errors.id and the category of its row
+	enum ItemDataRole
+	{
+		ErrorIdRole = Qt::UserRole,
+		CategoryRole
+	};
+
+	enum OpenMode
+	{
+		ReadWrite,
+		ReadOnly // Doesn't upgrade the schema, and can't load models (see QueryServer)
+	};
+
+	Database(const QString& sqliteFile, OpenMode mode = ReadWrite, QObject* parent = nullptr);
+	~Database();
 
 	void addSession(const Session& session);
 
+	// The name of a session in the session lists
+	static QString simplifyEntry(const QDateTime& timestamp, const QString& comments = QString());
+
+	// Writes the session to a standalone file (see SessionSnapshot)
+	bool exportSnapshot(const QString& session, const QString& filename);
+
+	// Every n-th session is stored in full. The others are stored as
+	// deltas against the latest full snapshot. Set to 1 to disable deltas.
+	void setSnapshotInterval(int n) {_snapshotInterval = n;}
+
+	// Memory budget for the loaded sessions that are kept for quick access
+	void setCacheBudget(int megabytes) {_tableCache.setMaxCost(megabytes*1024);}
+
 	// Functions to get pointers to the internal data
 	QAbstractListModel* sessionListModel() const {return _sessionListModel;}
-	QAbstractTableModel* fullModel() const {return _fullModel;}
-	QAbstractTableModel* diffModel_L() const {return _diffModel_L;}
-	QAbstractTableModel* diffModel_R() const {return _diffModel_R;}
+	QAbstractTableModel* fullModel() const;
+	QAbstractTableModel* diffModel_L() const;
+	QAbstractTableModel* diffModel_R() const;
+	QAbstractItemModel* summaryModel() const;
+	QAbstractTableModel* matchModel() const;
+	QAbstractTableModel* matrixModel() const;
 
-	// Functions to update internal data
+	// Functions to update internal data. The tables are loaded in the
+	// background (unless cached); superseded loads are cancelled.
 	void setFullModel(const QString& session);
 	void setDiffModels(const QString& session1, const QString& session2);
 
+	// Pairs up similar errors in the diff (e.g. a message was reworded, or a
+	// file was moved), and shows them in the match model instead
+	void setFuzzyMatching(bool enabled);
+
+	// Shows which errors are present in each session, with the sessions in
+	// chronological order. The rows are read in one pass, in the loader thread.
+	void setMatrixSessions(QStringList sessions);
+
+	enum PresenceFilter
+	{
+		AllErrors,
+		InAllSessions,
+		InSomeSessions,
+		NewInLastSessions,   // Only present in the last n sessions, including the latest
+		FixedInLastSessions, // Present before, but not in any of the last n sessions
+		IntermittentErrors   // Disappeared and came back
+	};
+	void setMatrixFilter(PresenceFilter filter, int n = 1);
+
+	// Counts errors by repo, file and message. If session2 is given, only the
+	// errors that are unique to each session are counted.
+	void setSummaryModel(const QString& session1, const QString& session2 = QString());
+
+	// Summary of the lines which were not recorded when the session was imported
+	UnrecordedLines unrecordedLines(const QString& session) const;
+
+	// Notes belong to errors, so they show up in every session. Each call
+	// writes all of its notes in a single transaction, then updates the
+	// loaded rows in place. Returns the number of annotated errors.
+	int annotateErrors(const QList<int>& errorIds, const QString& notes);
+
+	// Annotates every error whose "repo/file" path and message match the
+	// given patterns. '*' matches any text.
+	int annotateMatching(const QString& pathPattern, const QString& messagePattern, const QString& notes);
+
+	// For queries that run on other connections (see QueryServer). The row
+	// selections are SELECT statements that produce (id, error, line) rows;
+	// they are empty if a session doesn't exist.
+	QString fileName() const {return _db.databaseName();}
+	QStringList sessions() const {return _sessionListModel->stringList();}
+	QString rowSelection(const QString& session) const;
+	QString uniqueRowSelection(const QString& session, const QString& otherSession) const; // Errors not in otherSession
+	QMap<int, QString> sessionNames() const; // Sessions.id -> Session
+
+	// Reloads the sessions if another process has modified the database
+	void refreshSessions();
+
 public slots:
 	void removeSession(const QString& session);
 
+private slots:
+	void setTable(int target, int generation, int sessionId, const QSharedPointer<SessionTable>& table);
+	void dropFailedLoad(int target, int generation);
+	void setSignatures(int generation, const QHash<int, QByteArray>& signatures);
+	void setMatrix(int generation, const SessionMatrix& matrix);
+	void updateNotes(int errorId, const QString& notes);
+	void prefetchNeighbours();
+
 private:
-	static QString simplifyEntry(const QDateTime& timestamp, const QString& comments = QString());
+	typedef QPair<int, int> ErrorLine; // Errors.id, line number
+
+	void addColumn(const QString& table, const QString& column, const QString& type);
+	void classifyMessages();
 	int insert(const QString& table, QList<QPair<QString, QVariant>> fields);
+	QString sessionRows(int sessionId) const;
+	QVector<ErrorLine> readRows(int sessionId) const;
+	int latestSnapshot() const;
+	void writeRows(int sessionId, int baseId, const QVector<ErrorLine>& rows);
+	void writeUnrecordedLines(int sessionId, const UnrecordedLines& lines);
+	void loadSessions();
 	void refreshSessionList();
+	void requestTable(int target, int sessionId);
+	void queueLoad(int target, int sessionId);
+	void cancelLoad(int target);
+	QSharedPointer<SessionTable> cachedTable(int sessionId);
+	void updateDiffModels();
+	void matchSimilarErrors(QSharedPointer<SessionTable>* diffs, const QHash<int, QByteArray>& signatures);
+	void refreshNotes(const QSet<int>& errorIds, const QString& notes);
 
 	QSqlDatabase _db;
 
@@ -62,11 +208,43 @@ private:
 	QMap<QString, int> _fileMap;
 	QMap<QString, int> _msgMap;
 	QMap<quint32, int> _errorMap;
+	QMap<int, int> _baseMap; // Session ID -> Base session ID (0 for full snapshots)
+	QMap<int, int> _aliasMap; // Session ID -> ID of the identical session that holds the data
+	QMap<quint64, int> _hashMap; // Content hash -> Session ID
 
 	QStringListModel* _sessionListModel;
-	QSqlQueryModel* _fullModel;
-	QSqlQueryModel* _diffModel_L;
-	QSqlQueryModel* _diffModel_R;
+	DatabaseModel* _fullModel;
+	DatabaseModel* _diffModel_L;
+	DatabaseModel* _diffModel_R;
+	MatchModel* _matchModel;
+	MatrixModel* _matrixModel;
+	AggregateModel* _summaryModel;
+	QString _fullSession; // Session shown by _fullModel
+	QString _diffSession; // Session compared against _fullSession
+	QSharedPointer<SessionTable> _diffTables[2]; // Full tables of the sessions being diffed
+
+	bool _fuzzyMatching;
+	QSharedPointer<SessionTable> _unmatchedDiffs[2]; // Shown while their signatures are loaded
+
+	// Recently loaded sessions. Keyed by the session ID that owns the rows
+	// (i.e. aliases are resolved), costs are in kiB.
+	QCache<int, QSharedPointer<SessionTable>> _tableCache;
+	QTimer _prefetchTimer;
+
+	// Tables that the models are waiting for. Targets that need the same
+	// session share one load, which was queued by the owner.
+	struct PendingLoad
+	{
+		int sessionId; // Owns the rows
+		int owner; // SessionLoader::Target
+	};
+	QHash<int, PendingLoad> _pendingLoads; // SessionLoader::Target -> Load
+
+	QThread* _loaderThread;
+	SessionLoader* _loader;
+
+	int _snapshotInterval;
+	int _dataVersion; // See refreshSessions()
 };
 
 #endif // DATABASE_H
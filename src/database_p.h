@@ -4,16 +4,247 @@
 #ifndef DATABASE_P_H
 #define DATABASE_P_H
 
-#include <QSqlQueryModel>
+#include "database.h"
+#include <QAbstractTableModel>
+#include <QAbstractItemModel>
+#include <QStringList>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QAtomicInt>
 
-class DatabaseModel : public QSqlQueryModel
+class DatabaseModel : public QAbstractTableModel
 {
 	Q_OBJECT
 public:
-	explicit DatabaseModel(QObject* parent = nullptr) : QSqlQueryModel(parent) {}
+	enum Column
+	{
+		IdColumn,
+		RepoColumn,
+		FileColumn,
+		LineColumn,
+		MessageColumn,
+		CategoryColumn,
+		NotesColumn,
+		ColumnCount
+	};
+
+	explicit DatabaseModel(QObject* parent = nullptr) : QAbstractTableModel(parent) {}
+
+	void setTable(const QSharedPointer<SessionTable>& table);
+	void updateNotes(const QSet<int>& errorIds, const QString& notes);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
 	Qt::ItemFlags flags(const QModelIndex& index) const;
 	bool setData(const QModelIndex& index, const QVariant& value, int role);
+
+signals:
+	void notesEdited(int errorId, const QString& notes) const;
+
+private:
+	QSharedPointer<SessionTable> _table;
+};
+
+// An error that only appears in the left session of a diff, and a similar
+// error that only appears in the right session
+struct ErrorMatch
+{
+	SessionRow left;
+	SessionRow right;
+	double similarity;
+};
+
+class MatchModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+public:
+	enum Column
+	{
+		SimilarityColumn,
+		FileColumn_L,
+		LineColumn_L,
+		MessageColumn_L,
+		FileColumn_R,
+		LineColumn_R,
+		MessageColumn_R,
+		ColumnCount
+	};
+
+	explicit MatchModel(QObject* parent = nullptr) : QAbstractTableModel(parent) {}
+
+	void setMatches(const QVector<ErrorMatch>& matches);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+private:
+	QVector<ErrorMatch> _matches;
+};
+
+// Errors as rows, sessions as columns. Presence is stored as one bitset per
+// error, so that the presence filters only need bit operations.
+class MatrixModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+public:
+	enum Column
+	{
+		RepoColumn,
+		FileColumn,
+		MessageColumn,
+		CountColumn,
+		SessionColumn // One for each session
+	};
+
+	typedef SessionMatrix::Error Error;
+
+	explicit MatrixModel(QObject* parent = nullptr);
+
+	void setMatrix(const SessionMatrix& matrix);
+	void setPresenceFilter(int filter, int n);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+private:
+	bool isPresent(int error, int session) const
+	{return (_bits[error*_wordsPerError + session/64] >> (session%64)) & 1;}
+
+	bool isAccepted(int error) const;
+	void updateRows();
+
+	QStringList _sessions;
+	QVector<Error> _errors;
+	QVector<quint64> _bits;
+	QVector<int> _counts; // Number of sessions that contain each error
+	int _wordsPerError;
+
+	int _filter; // Database::PresenceFilter
+	int _n;
+	QVector<int> _rows; // Errors that pass the filter
+};
+
+// Tree of error counts, grouped by repo, then file, then message. Each level
+// is only queried when it is expanded, and the results are cached.
+class AggregateModel : public QAbstractItemModel
+{
+	Q_OBJECT
+
+public:
+	explicit AggregateModel(QObject* parent = nullptr);
+
+	// Each row selection (see Database::sessionRows()) gets its own count column.
+	// cacheKey must uniquely identify the row selections.
+	void setRowSelections(const QString& cacheKey, const QStringList& rowSelections, const QStringList& countLabels);
+	void clearCache() {_cache.clear();}
+
+	QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const;
+	QModelIndex parent(const QModelIndex& index) const;
+	int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const;
+	bool hasChildren(const QModelIndex& parent = QModelIndex()) const;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+	bool canFetchMore(const QModelIndex& parent) const;
+	void fetchMore(const QModelIndex& parent);
+
+private:
+	enum Depth
+	{
+		RootDepth,
+		RepoDepth,
+		FileDepth,
+		MessageDepth
+	};
+
+	struct Group
+	{
+		int key; // ID of the repo, file or message
+		QString name;
+		QVector<int> counts;
+	};
+
+	struct Node
+	{
+		int parent;
+		int row;
+		int depth;
+		bool fetched;
+		Group group;
+		QVector<int> children;
+	};
+
+	int nodeIndex(const QModelIndex& index) const {return index.isValid() ? int(index.internalId()) : 0;}
+	QVector<Group> queryGroups(int depth, int parentKey) const;
+
+	QString _cacheKey;
+	QStringList _rowSelections;
+	QStringList _countLabels;
+	QVector<Node> _nodes; // _nodes[0] is the invisible root
+
+	QHash<QString, QVector<Group>> _cache;
+};
+
+// Runs the session queries in a worker thread, using its own connection.
+// A load is abandoned as soon as a newer load is requested for the same target.
+class SessionLoader : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Target
+	{
+		FullTable,
+		DiffTable_L,
+		DiffTable_R,
+		Prefetch,
+		Signatures,
+		Matrix,
+		TargetCount
+	};
+
+	explicit SessionLoader(const QString& sqliteFile) : _sqliteFile(sqliteFile) {}
+	~SessionLoader();
+
+	// Thread-safe
+	int nextGeneration(int target) {return _generations[target].fetchAndAddOrdered(1) + 1;}
+	int generation(int target) const {return _generations[target].load();}
+
+public slots:
+	void load(int target, int generation, int sessionId, const QString& query);
+
+	// Computes and stores the signatures that are missing (e.g. in databases
+	// created by older versions)
+	void loadSignatures(int generation, const QVector<int>& errorIds);
+
+	// dataIds[c] is the session that holds the rows of sessions[c], and
+	// baseIds[c] is the base of dataIds[c] (0 for full snapshots)
+	void loadMatrix(int generation, const QStringList& sessions,
+			const QVector<int>& dataIds, const QVector<int>& baseIds);
+
+signals:
+	void loaded(int target, int generation, int sessionId, const QSharedPointer<SessionTable>& table) const;
+	void signaturesLoaded(int generation, const QHash<int, QByteArray>& signatures) const;
+	void matrixLoaded(int generation, const SessionMatrix& matrix) const;
+	void failed(int target, int generation) const;
+
+private:
+	bool isStale(int target, int generation) const {return generation != _generations[target].load();}
+	void openConnection();
+
+	QString _sqliteFile;
+	QSqlDatabase _db;
+	QAtomicInt _generations[TargetCount];
 };
 
 #endif // DATABASE_P_H
@@ -35,8 +35,7 @@ FileSelectionDialog::FileSelectionDialog(QWidget *parent)
 
 	// Upon button click, ask for the build root. This path will later be stripped
 	// from the data, so that builds from different paths/machines can be compared.
-	//
-	// TODO: Use heuristics to find the build root from the log
+	// If left blank, the parser detects the build root from the log.
 	connect(tb_root, &QToolButton::clicked, [=]()
 	{
 		QString buildRootPath = QFileDialog::getExistingDirectory(nullptr,
@@ -52,7 +51,7 @@ FileSelectionDialog::FileSelectionDialog(QWidget *parent)
 	connect(this, &FileSelectionDialog::accepted, [=]()
 	{
 		QString buildRoot = le_root->text();
-		if (!buildRoot.endsWith('/'))
+		if (!buildRoot.isEmpty() && !buildRoot.endsWith('/'))
 			buildRoot += '/';
 
 		_settings.setValue("LogPath", le_file->text());
@@ -3,12 +3,22 @@
 
 #include "gui.h"
 #include "fileselectiondialog.h"
+#include "database.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QSortFilterProxyModel>
 #include <QKeyEvent>
 #include <QClipboard>
+#include <QMenu>
+#include <QInputDialog>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QLineEdit>
+#include <QLabel>
+#include <QSet>
+#include <QRegExp>
 
 //======================================================================
 // GUI
@@ -31,22 +41,118 @@ Gui::Gui(QWidget *parent)
 	connect(fileSelectionDialog, &FileSelectionDialog::fileSelected,
 			this, &Gui::newFileSelected);
 
+	connect(pb_openSnapshot, &QPushButton::clicked, [=]()
+	{
+		QString filename = QFileDialog::getOpenFileName(this, "Open Snapshot",
+				QString(), "Snapshots (*.qdetsnap);;All files (*)");
+		if (!filename.isEmpty())
+			emit snapshotOpenRequested(filename);
+	});
+
 	// Enable the 2nd list in "Diff" mode only
+	auto updateListView_R = [=]()
+	{
+		QWidget* tab = tabWidget->currentWidget();
+		listView_R->setEnabled(tab == tab_diff
+				|| (tab == tab_summary && cb_summaryDiff->isChecked()));
+	};
+	connect(cb_summaryDiff, &QCheckBox::toggled, [=]()
+	{
+		updateListView_R();
+		_selectionTimer.start();
+	});
+
+	connect(cb_category, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged), [=]()
+	{
+		applyCategoryFilter();
+	});
+
+	// Similar errors are only shown when they are matched
+	label_matches->hide();
+	tv_matches->hide();
+	connect(cb_fuzzyMatch, &QCheckBox::toggled, [=](bool checked)
+	{
+		label_matches->setVisible(checked);
+		tv_matches->setVisible(checked);
+		emit fuzzyMatchingToggled(checked);
+	});
+
+	// The matrix is only computed on request, as it reads every checked session
+	connect(pb_matrix, &QPushButton::clicked, [=]()
+	{
+		QStringList sessions;
+		for (int i = 0; i < lw_matrixSessions->count(); ++i)
+		{
+			QListWidgetItem* item = lw_matrixSessions->item(i);
+			if (item->checkState() == Qt::Checked)
+				sessions << item->text();
+		}
+		emit matrixRequested(sessions);
+	});
+
+	cb_matrixFilter->addItem("All errors", Database::AllErrors);
+	cb_matrixFilter->addItem("In all sessions", Database::InAllSessions);
+	cb_matrixFilter->addItem("In some sessions", Database::InSomeSessions);
+	cb_matrixFilter->addItem("New in the last N sessions", Database::NewInLastSessions);
+	cb_matrixFilter->addItem("Fixed in the last N sessions", Database::FixedInLastSessions);
+	cb_matrixFilter->addItem("Disappeared and came back", Database::IntermittentErrors);
+
+	auto updateMatrixFilter = [=]()
+	{
+		int filter = cb_matrixFilter->itemData(cb_matrixFilter->currentIndex()).toInt();
+		sb_lastN->setEnabled(filter == Database::NewInLastSessions || filter == Database::FixedInLastSessions);
+		emit matrixFilterChanged(filter, sb_lastN->value());
+	};
+	connect(cb_matrixFilter, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged), updateMatrixFilter);
+	connect(sb_lastN, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), updateMatrixFilter);
+	sb_lastN->setEnabled(false);
+
+	// The summary is only computed while it is visible
 	connect(tabWidget, &QTabWidget::currentChanged, [=]()
 	{
-		listView_R->setEnabled(tabWidget->currentIndex() == 1);
+		updateListView_R();
+		if (tabWidget->currentWidget() == tab_summary)
+			_selectionTimer.start();
 	});
 
-	connect(listView_L, &SessionListView::sessionChanged,
-			this, &Gui::requestNewTables);
-	connect(listView_R, &SessionListView::sessionChanged,
+	// Wait for the selection to settle (e.g. while the user scrolls through
+	// the list with the arrow keys) before requesting new tables
+	_selectionTimer.setSingleShot(true);
+	_selectionTimer.setInterval(150);
+	connect(&_selectionTimer, &QTimer::timeout,
 			this, &Gui::requestNewTables);
 
+	connect(listView_L, &SessionListView::sessionChanged, [=]()
+	{
+		_selectionTimer.start();
+	});
+	connect(listView_R, &SessionListView::sessionChanged, [=]()
+	{
+		_selectionTimer.start();
+	});
+
 	connect(listView_L, &SessionListView::deletionRequested,
 			this, &Gui::deletionRequested);
 	connect(listView_R, &SessionListView::deletionRequested,
 			this, &Gui::deletionRequested);
 
+	connect(listView_L, &SessionListView::unrecordedLinesRequested,
+			this, &Gui::unrecordedLinesRequested);
+	connect(listView_R, &SessionListView::unrecordedLinesRequested,
+			this, &Gui::unrecordedLinesRequested);
+
+	connect(listView_L, &SessionListView::snapshotExportRequested,
+			this, &Gui::snapshotExportRequested);
+	connect(listView_R, &SessionListView::snapshotExportRequested,
+			this, &Gui::snapshotExportRequested);
+
+	for (SpreadsheetView* view : {tv_full, tv_diff_L, tv_diff_R})
+	{
+		connect(view, &SpreadsheetView::annotationRequested,
+				this, &Gui::annotationRequested);
+		connect(view, &SpreadsheetView::matchingAnnotationRequested,
+				this, &Gui::matchingAnnotationRequested);
+	}
 }
 
 
@@ -64,6 +170,65 @@ Gui::requestNewTables() const
 	QString session_R = listView_L->model()->data(index_R).toString();
 
 	emit sessionSelectionChanged(session_L, session_R);
+
+	if (tabWidget->currentWidget() == tab_summary)
+		emit summarySelectionChanged(session_L, cb_summaryDiff->isChecked() ? session_R : QString());
+}
+
+// Counts the rows of the full session in each category. The filter is kept.
+void
+Gui::updateCategoryCounts()
+{
+	auto proxy = qobject_cast<QSortFilterProxyModel*>(tv_full->model());
+	QAbstractItemModel* model = proxy ? proxy->sourceModel() : nullptr;
+	int total = model ? model->rowCount() : 0;
+
+	QVector<int> counts(_categoryNames.size(), 0);
+	for (int row = 0; row < total; ++row)
+	{
+		int category = model->index(row, 0).data(Database::CategoryRole).toInt();
+		if (category >= 0 && category < counts.size())
+			++counts[category];
+	}
+
+	int current = cb_category->itemData(cb_category->currentIndex()).toInt();
+	if (cb_category->count() == 0)
+		current = -1;
+
+	cb_category->blockSignals(true);
+	cb_category->clear();
+	cb_category->addItem(QString("All categories (%1)").arg(total), -1);
+	for (int c = 0; c < _categoryNames.size(); ++c)
+	{
+		if (counts[c] > 0 || c == current)
+			cb_category->addItem(QString("%1 (%2)").arg(_categoryNames[c]).arg(counts[c]), c);
+	}
+	cb_category->setCurrentIndex(qMax(0, cb_category->findData(current)));
+	cb_category->blockSignals(false);
+
+	applyCategoryFilter();
+}
+
+// Lists the sessions in the matrix tab. The checked sessions stay checked.
+void
+Gui::updateMatrixSessions()
+{
+	QSet<QString> checked;
+	for (int i = 0; i < lw_matrixSessions->count(); ++i)
+	{
+		QListWidgetItem* item = lw_matrixSessions->item(i);
+		if (item->checkState() == Qt::Checked)
+			checked << item->text();
+	}
+
+	lw_matrixSessions->clear();
+	QAbstractItemModel* model = listView_L->model();
+	for (int row = 0; row < model->rowCount(); ++row)
+	{
+		auto item = new QListWidgetItem(model->index(row, 0).data().toString(), lw_matrixSessions);
+		item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+		item->setCheckState(checked.contains(item->text()) ? Qt::Checked : Qt::Unchecked);
+	}
 }
 
 
@@ -81,6 +246,10 @@ Gui::setFullModel(QAbstractTableModel* model)
 
 	if (oldProxy)
 		oldProxy->deleteLater();
+
+	connect(model, &QAbstractItemModel::modelReset,
+			this, &Gui::updateCategoryCounts, Qt::UniqueConnection);
+	updateCategoryCounts();
 }
 
 void
@@ -102,16 +271,88 @@ Gui::setDiffModels(QAbstractTableModel* leftModel, QAbstractTableModel* rightMod
 		oldProxy_R->deleteLater();
 }
 
+void
+Gui::setMatchModel(QAbstractTableModel* model)
+{
+	auto oldProxy = tv_matches->model();
+	auto newProxy = new QSortFilterProxyModel(this);
+
+	newProxy->setSourceModel(model);
+	tv_matches->setModel(newProxy);
+
+	// Show the least certain matches first, as those need to be checked
+	tv_matches->sortByColumn(0, Qt::AscendingOrder);
+
+	if (oldProxy)
+		oldProxy->deleteLater();
+}
+
+void
+Gui::setMatrixModel(QAbstractTableModel* model)
+{
+	auto oldProxy = tv_matrix->model();
+	auto newProxy = new QSortFilterProxyModel(this);
+
+	newProxy->setSourceModel(model);
+	tv_matrix->setModel(newProxy);
+
+	if (oldProxy)
+		oldProxy->deleteLater();
+}
+
+void
+Gui::setSummaryModel(QAbstractItemModel* model)
+{
+	auto oldProxy = tv_summary->model();
+	auto newProxy = new QSortFilterProxyModel(this);
+
+	newProxy->setSourceModel(model);
+	tv_summary->setModel(newProxy);
+
+	// Show the noisiest groups first
+	tv_summary->sortByColumn(1, Qt::DescendingOrder);
+
+	if (oldProxy)
+		oldProxy->deleteLater();
+}
+
 void
 Gui::setSessionLists(QAbstractListModel* model)
 {
 	listView_L->setModel(model);
 	listView_R->setModel(model);
 
+	connect(model, &QAbstractItemModel::modelReset,
+			this, &Gui::updateMatrixSessions, Qt::UniqueConnection);
+	updateMatrixSessions();
+
 	// Show the errors in the latest session (but not the diff)
 	listView_L->setCurrentIndex(listView_L->model()->index(0, 0));
 }
 
+void
+Gui::setCategoryNames(const QStringList& names)
+{
+	_categoryNames = names;
+	updateCategoryCounts();
+}
+
+
+/**********************************************************************\
+ * PRIVATE
+\**********************************************************************/
+void
+Gui::applyCategoryFilter()
+{
+	auto proxy = qobject_cast<QSortFilterProxyModel*>(tv_full->model());
+	if (!proxy)
+		return;
+
+	int category = cb_category->itemData(cb_category->currentIndex()).toInt();
+	proxy->setFilterRole(Database::CategoryRole);
+	proxy->setFilterRegExp(category < 0 ? QString() : QString("^%1$").arg(category));
+}
+
 
 //======================================================================
 // SESSIONLISTVIEW
@@ -121,14 +362,48 @@ SessionListView::keyPressEvent(QKeyEvent* event)
 {
 	QString session = model()->data(currentIndex()).toString();
 	if (event->matches(QKeySequence::Delete) && !session.isEmpty())
+		confirmDeletion(session);
+	else
+		QListView::keyPressEvent(event);
+}
+
+void
+SessionListView::contextMenuEvent(QContextMenuEvent* event)
+{
+	QString session = model()->data(indexAt(event->pos())).toString();
+	if (session.isEmpty())
+		return;
+
+	QMenu menu;
+	QAction* unrecordedAction = menu.addAction("Show Unrecorded Lines");
+	QAction* exportAction = menu.addAction("Export Snapshot...");
+	QAction* deleteAction = menu.addAction("Delete");
+
+	QAction* selection = menu.exec(event->globalPos());
+	if (selection == unrecordedAction)
+		emit unrecordedLinesRequested(session);
+	else if (selection == exportAction)
 	{
-		QString question = "Delete the session \""
-				+ session
-				+ "\"? This action cannot be undone.";
-		auto selection = QMessageBox::question(nullptr, "Confirm Deletion", question);
-		if (selection == QMessageBox::Yes)
-			emit deletionRequested(session);
+		// Session names contain ':', which isn't allowed in all file systems
+		QString suggestion = QString(session).replace(QRegExp("[^A-Za-z0-9_. -]"), "_") + ".qdetsnap";
+		QString filename = QFileDialog::getSaveFileName(this, "Export Snapshot",
+				suggestion, "Snapshots (*.qdetsnap)");
+		if (!filename.isEmpty())
+			emit snapshotExportRequested(session, filename);
 	}
+	else if (selection == deleteAction)
+		confirmDeletion(session);
+}
+
+void
+SessionListView::confirmDeletion(const QString& session)
+{
+	QString question = "Delete the session \""
+			+ session
+			+ "\"? This action cannot be undone.";
+	auto selection = QMessageBox::question(nullptr, "Confirm Deletion", question);
+	if (selection == QMessageBox::Yes)
+		emit deletionRequested(session);
 }
 
 
@@ -146,6 +421,24 @@ SpreadsheetView::keyPressEvent(QKeyEvent *event)
 	// TODO: Implement delete/cut/paste
 }
 
+void
+SpreadsheetView::contextMenuEvent(QContextMenuEvent* event)
+{
+	QModelIndex index = indexAt(event->pos());
+	if (!index.isValid())
+		return;
+
+	QMenu menu;
+	QAction* selectedAction = menu.addAction("Annotate Selected Rows...");
+	QAction* matchingAction = menu.addAction("Annotate Matching Errors...");
+
+	QAction* selection = menu.exec(event->globalPos());
+	if (selection == selectedAction)
+		annotateSelectedRows();
+	else if (selection == matchingAction)
+		annotateMatchingErrors(index);
+}
+
 void
 SpreadsheetView::copySelectedText() const
 {
@@ -193,3 +486,77 @@ SpreadsheetView::copySelectedText() const
 		QGuiApplication::clipboard()->setText(text);
 	}
 }
+
+void
+SpreadsheetView::annotateSelectedRows()
+{
+	// Rows are selected by selecting any of their cells.
+	// The source model provides the Errors.id of each row.
+	QSet<int> rows;
+	QList<int> errorIds;
+	for (const QModelIndex& index : selectionModel()->selectedIndexes())
+	{
+		if (!rows.contains(index.row()))
+		{
+			rows << index.row();
+			errorIds << index.data(Database::ErrorIdRole).toInt();
+		}
+	}
+	if (errorIds.isEmpty())
+		return;
+
+	bool ok = false;
+	QString notes = QInputDialog::getText(this, "Annotate Selected Rows",
+			QString("Notes for the %1 selected row(s):").arg(rows.size()),
+			QLineEdit::Normal, columnData(currentIndex().row(), "notes").toString(), &ok);
+	if (ok)
+		emit annotationRequested(errorIds, notes);
+}
+
+void
+SpreadsheetView::annotateMatchingErrors(const QModelIndex& index)
+{
+	// Start with the patterns of the clicked error. Only the first line of
+	// a multi-line message fits in the editor.
+	QString path = columnData(index.row(), "repo").toString()
+			+ '/' + columnData(index.row(), "file").toString();
+	QString message = columnData(index.row(), "message").toString();
+	if (message.contains('\n'))
+		message = message.section('\n', 0, 0) + '*';
+
+	QDialog dialog(this);
+	dialog.setWindowTitle("Annotate Matching Errors");
+
+	auto le_path = new QLineEdit(path);
+	auto le_message = new QLineEdit(message);
+	auto le_notes = new QLineEdit(columnData(index.row(), "notes").toString());
+	auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok|QDialogButtonBox::Cancel);
+	connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+	connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+	auto layout = new QFormLayout(&dialog);
+	auto label = new QLabel("Every error in the database that matches both patterns "
+			"will be annotated. Use * to match any text.");
+	label->setWordWrap(true);
+	layout->addRow(label);
+	layout->addRow("Path:", le_path);
+	layout->addRow("Message:", le_message);
+	layout->addRow("Notes:", le_notes);
+	layout->addRow(buttons);
+	dialog.resize(600, dialog.sizeHint().height());
+
+	if (dialog.exec() == QDialog::Accepted)
+		emit matchingAnnotationRequested(le_path->text(), le_message->text(), le_notes->text());
+}
+
+// Finds the column by its header, so that this view doesn't depend on the model's layout
+QVariant
+SpreadsheetView::columnData(int row, const QString& header) const
+{
+	for (int col = 0; col < model()->columnCount(); ++col)
+	{
+		if (model()->headerData(col, Qt::Horizontal).toString() == header)
+			return model()->index(row, col).data();
+	}
+	return QVariant();
+}
@@ -5,9 +5,12 @@
 #define GUI_H
 
 #include "ui_gui.h"
+#include <QTimer>
+#include <QStringList>
 
 class QAbstractTableModel;
 class QAbstractListModel;
+class QAbstractItemModel;
 
 class Gui : public QWidget, private Ui::Gui
 {
@@ -18,15 +21,36 @@ public:
 
 	void setFullModel(QAbstractTableModel* model);
 	void setDiffModels(QAbstractTableModel* leftModel, QAbstractTableModel* rightModel);
+	void setSummaryModel(QAbstractItemModel* model);
+	void setMatchModel(QAbstractTableModel* model);
+	void setMatrixModel(QAbstractTableModel* model);
 	void setSessionLists(QAbstractListModel* model);
+	void setCategoryNames(const QStringList& names);
 
 signals:
 	void newFileSelected(const QString& filename, const QString& buildRoot, const QDateTime& timestamp, const QString& comments) const;
 	void sessionSelectionChanged(const QString& session_L, const QString& session_R) const;
+	void summarySelectionChanged(const QString& session_L, const QString& session_R) const;
+	void fuzzyMatchingToggled(bool enabled) const;
+	void matrixRequested(const QStringList& sessions) const;
+	void matrixFilterChanged(int filter, int n) const;
 	void deletionRequested(const QString& session) const;
+	void unrecordedLinesRequested(const QString& session) const;
+	void snapshotExportRequested(const QString& session, const QString& filename) const;
+	void snapshotOpenRequested(const QString& filename) const;
+	void annotationRequested(const QList<int>& errorIds, const QString& notes) const;
+	void matchingAnnotationRequested(const QString& pathPattern, const QString& messagePattern, const QString& notes) const;
 
 private slots:
 	void requestNewTables() const;
+	void updateCategoryCounts();
+	void updateMatrixSessions();
+
+private:
+	void applyCategoryFilter();
+
+	QTimer _selectionTimer;
+	QStringList _categoryNames;
 };
 
 #endif // GUI_H
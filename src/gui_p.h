@@ -17,6 +17,8 @@ public:
 signals:
 	void sessionChanged() const;
 	void deletionRequested(const QString& session) const;
+	void unrecordedLinesRequested(const QString& session) const;
+	void snapshotExportRequested(const QString& session, const QString& filename) const;
 
 protected slots:
 	void selectionChanged(const QItemSelection& /*selected*/, const QItemSelection& /*deselected*/)
@@ -24,6 +26,10 @@ protected slots:
 
 protected:
 	void keyPressEvent(QKeyEvent* event);
+	void contextMenuEvent(QContextMenuEvent* event);
+
+private:
+	void confirmDeletion(const QString& session);
 };
 
 class SpreadsheetView : public QTableView
@@ -33,11 +39,19 @@ class SpreadsheetView : public QTableView
 public:
 	SpreadsheetView(QWidget* parent = nullptr) : QTableView(parent) {}
 
+signals:
+	void annotationRequested(const QList<int>& errorIds, const QString& notes) const;
+	void matchingAnnotationRequested(const QString& pathPattern, const QString& messagePattern, const QString& notes) const;
+
 protected:
 	void keyPressEvent(QKeyEvent *event);
+	void contextMenuEvent(QContextMenuEvent* event);
 
 private:
 	void copySelectedText() const;
+	void annotateSelectedRows();
+	void annotateMatchingErrors(const QModelIndex& index);
+	QVariant columnData(int row, const QString& header) const;
 };
 
 #endif // GUI_P_H
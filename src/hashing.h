@@ -0,0 +1,48 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <QStringRef>
+
+// Hashes are stored in databases and snapshots, so these must never change
+
+static const quint64 fnvOffsetBasis = Q_UINT64_C(14695981039346656037);
+
+// 64-bit FNV-1a over bytes
+inline quint64
+hashBytes(const void* data, int size, quint64 hash = fnvOffsetBasis)
+{
+	auto bytes = static_cast<const uchar*>(data);
+	for (int i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= Q_UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+// 64-bit FNV-1a over UTF-16 code units (one step per QChar, unlike hashBytes())
+inline quint64
+hashString(const QStringRef& str, quint64 hash = fnvOffsetBasis)
+{
+	const QChar* data = str.unicode();
+	for (int i = 0; i < str.size(); ++i)
+	{
+		hash ^= data[i].unicode();
+		hash *= Q_UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+// Scrambles the bits of a hash (SplitMix64 finalizer)
+inline quint64
+mix(quint64 hash)
+{
+	hash = (hash ^ (hash >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+	hash = (hash ^ (hash >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+	return hash ^ (hash >> 31);
+}
+
+#endif // HASHING_H
@@ -0,0 +1,253 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "logparser.h"
+#include "messageclassifier.h"
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QDebug>
+
+//======================================================================
+// PATHTRIE
+//======================================================================
+// Collects the directories of the files that QDoc complained about, to find
+// the build root. Each node is a path component.
+class PathTrie
+{
+public:
+	PathTrie() : _nodes(1) {}
+
+	void insertFile(const QString& filePath);
+	QString commonRoot() const;
+
+private:
+	struct Node
+	{
+		Node() : hasFiles(false) {}
+
+		QHash<QString, int> children;
+		bool hasFiles;
+	};
+
+	static bool isRepoSubdir(const QString& component);
+	bool isRepo(const QString& component, int node) const;
+
+	QVector<Node> _nodes;
+	QString _lastDir;
+};
+
+void
+PathTrie::insertFile(const QString& filePath)
+{
+	QString dir = filePath.left(filePath.lastIndexOf('/'));
+
+	// Consecutive warnings tend to come from the same directory
+	if (dir == _lastDir)
+		return;
+	_lastDir = dir;
+
+	int n = 0;
+	for (const QString& component : dir.split('/'))
+	{
+		auto it = _nodes[n].children.constFind(component);
+		if (it != _nodes[n].children.constEnd())
+			n = it.value();
+		else
+		{
+			_nodes[n].children[component] = _nodes.size();
+			n = _nodes.size();
+			_nodes.append(Node());
+		}
+	}
+	_nodes[n].hasFiles = true;
+}
+
+QString
+PathTrie::commonRoot() const
+{
+	// Find the longest chain of directories shared by all files
+	QStringList chain;
+	int n = 0;
+	while (_nodes[n].children.size() == 1 && !_nodes[n].hasFiles)
+	{
+		auto it = _nodes[n].children.constBegin();
+		chain << it.key();
+		n = it.value();
+	}
+
+	// If the files came from several repos, the shared chain ends right above
+	// them, e.g. at ".../qt5" for ".../qt5/qtbase/src" and ".../qt5/qtdoc/doc"
+	bool aboveRepos = false;
+	for (auto it = _nodes[n].children.constBegin(); it != _nodes[n].children.constEnd(); ++it)
+		aboveRepos |= isRepo(it.key(), it.value());
+
+	// Otherwise, all files came from a single repo, and the shared chain goes
+	// right into it. Stop at the deepest "qt*" directory which looks like a
+	// repo, as its parents can look like one too (".../qt/src/qt5/qtbase/src")
+	for (int i = chain.size() - 1; i >= 0 && !aboveRepos; --i)
+	{
+		bool repoFound = (i + 1 < chain.size())
+				? chain[i].startsWith("qt") && isRepoSubdir(chain[i + 1])
+				: isRepo(chain[i], n);
+		if (repoFound)
+		{
+			chain = chain.mid(0, i);
+			break;
+		}
+	}
+
+	if (chain.isEmpty())
+		return QString();
+	return chain.join('/') + '/';
+}
+
+// A "qt*" directory that contains e.g. "src" or "doc"
+bool
+PathTrie::isRepo(const QString& component, int node) const
+{
+	if (!component.startsWith("qt"))
+		return false;
+
+	for (auto it = _nodes[node].children.constBegin(); it != _nodes[node].children.constEnd(); ++it)
+	{
+		if (isRepoSubdir(it.key()))
+			return true;
+	}
+	return false;
+}
+
+bool
+PathTrie::isRepoSubdir(const QString& component)
+{
+	static const QStringList subdirs = QStringList()
+			<< "src" << "examples" << "doc" << "tools" << "tests" << "util" << "qmake";
+
+	return subdirs.contains(component);
+}
+
+//======================================================================
+// LOGPARSER
+//======================================================================
+// Splits a line like "/path/to/file.qdoc:28: warning: ..." into its path,
+// line number and message. Returns false if the line doesn't start with a path.
+static bool
+splitEntry(const QString& line, QStringRef* path, int* lineNumber, QStringRef* message)
+{
+	int sep = line.indexOf(": ");
+	if (sep < 0)
+		return false;
+
+	*path = line.midRef(0, sep);
+	*lineNumber = -1;
+	*message = line.midRef(sep + 2);
+
+	int lineSep = path->lastIndexOf(':');
+	if (lineSep > 0 && lineSep + 1 < sep)
+	{
+		int number = 0;
+		for (int i = lineSep + 1; i < sep && number >= 0; ++i)
+			number = line.at(i).isDigit() ? number*10 + line.at(i).digitValue() : -1;
+
+		if (number >= 0)
+		{
+			*path = line.midRef(0, lineSep);
+			*lineNumber = number;
+		}
+	}
+
+	return path->contains('/');
+}
+
+// QDoc's own diagnostics. Only these are used to detect the build root, as
+// other tools (e.g. the linker) can print paths from outside the sources.
+static bool
+isDiagnostic(const QStringRef& message)
+{
+	return message.startsWith("warning") || message.startsWith("error");
+}
+
+ParsedLog
+LogParser::parse(QFile& logFile)
+{
+	// Record the entries with their full paths while streaming the log. They
+	// are split into repo and file once the build root is known.
+	ParsedLog log;
+	PathTrie trie;
+	const MessageClassifier& classifier = MessageClassifier::instance();
+	bool userRootFound = false;
+	_unrecordedLines = UnrecordedLines();
+
+	// Entries outside the build root are unrecorded, but the root might only
+	// be known at the end. Keep the offsets of the lines that might be outside
+	// it, with the path of their entry.
+	QVector<QPair<qint64, QString>> uncertainLines;
+	QString lastPath;
+	bool lastUncertain = false;
+	while (!logFile.atEnd())
+	{
+		qint64 offset = logFile.pos();
+		QString line = logFile.readLine();
+		line.remove('\n');
+		if (line.isEmpty())
+			continue;
+
+		// Expect a format like
+		// "C:/Qt/git/5.x.y/qtxmlpatterns/examples/xmlpatterns/xquery/doc/src/globalVariables.qdoc:28: warning:   EXAMPLE PATH DOES NOT EXIST: xmlpatterns/xquery/globalVariables"
+		QStringRef path;
+		QStringRef message;
+		int lineNumber;
+		if (splitEntry(line, &path, &lineNumber, &message))
+		{
+			// A detected build root covers all of the diagnostics
+			bool insideUserRoot = !_buildRoot.isEmpty() && path.startsWith(_buildRoot);
+			if (isDiagnostic(message))
+			{
+				trie.insertFile(path.toString());
+				userRootFound |= insideUserRoot;
+				lastUncertain = !_buildRoot.isEmpty() && !insideUserRoot;
+			}
+			else
+				lastUncertain = !insideUserRoot;
+
+			lastPath = path.toString();
+			if (lastUncertain)
+				uncertainLines << qMakePair(offset, lastPath);
+
+			// Continuation lines are appended below, but don't affect the category
+			log.append(path, lineNumber, message, classifier.classify(message));
+		}
+		else if (line.startsWith("    ") && log.count() > 0)
+		{
+			if (lastUncertain)
+				uncertainLines << qMakePair(offset, lastPath);
+			log.appendToLastMessage('\n' + line);
+		}
+		else
+			_unrecordedLines.append(offset, line);
+	}
+
+	_buildRootDetected = !userRootFound;
+	if (_buildRootDetected)
+		_buildRoot = trie.commonRoot();
+
+	// setBuildRoot() removes the entries outside the root
+	if (!_buildRoot.isEmpty())
+	{
+		UnrecordedLines outsideRoot;
+		for (const auto& uncertain : uncertainLines)
+		{
+			if (uncertain.second.startsWith(_buildRoot))
+				continue;
+
+			logFile.seek(uncertain.first);
+			QString line = logFile.readLine();
+			line.remove('\n');
+			outsideRoot.append(uncertain.first, line);
+		}
+		_unrecordedLines.merge(outsideRoot);
+	}
+
+	log.setBuildRoot(_buildRoot);
+	return log;
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef LOGPARSER_H
+#define LOGPARSER_H
+
+#include "parsedlog.h"
+#include "unrecordedlines.h"
+
+class QFile;
+
+class LogParser
+{
+public:
+	// If buildRoot is empty (or doesn't match any warnings in the log),
+	// the build root is detected from the log itself
+	explicit LogParser(const QString& buildRoot = QString())
+		: _buildRoot(buildRoot), _buildRootDetected(false) {}
+
+	ParsedLog parse(QFile& logFile);
+
+	// Results from the last call to parse()
+	QString buildRoot() const {return _buildRoot;}
+	bool buildRootDetected() const {return _buildRootDetected;}
+	const UnrecordedLines& unrecordedLines() const {return _unrecordedLines;}
+
+private:
+	QString _buildRoot;
+	bool _buildRootDetected;
+	UnrecordedLines _unrecordedLines;
+};
+
+#endif // LOGPARSER_H
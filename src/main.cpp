@@ -2,117 +2,132 @@
 // This code is licensed under the MIT license (see LICENSE.txt for details)
 
 #include <QApplication>
-#include <QTextEdit>
 #include <QMessageBox>
 #include <QStandardPaths>
 #include <QDir>
 #include <QFile>
+#include <QSettings>
+#include <QThread>
+#include <cstdio>
 #include "database.h"
+#include "logparser.h"
+#include "queryserver.h"
+#include "sessionsnapshot.h"
+#include "messageclassifier.h"
 #include "gui.h"
 
 static void
 popupWarning(QtMsgType type, const QMessageLogContext& /*context*/, const QString& msg)
 {
-	QMessageBox::warning(nullptr, "Warning", msg);
+	// Widgets can only be used in the GUI thread of a GUI application
+	auto app = qobject_cast<QApplication*>(QCoreApplication::instance());
+	if (app && QThread::currentThread() == app->thread())
+		QMessageBox::warning(nullptr, "Warning", msg);
+	else
+		fprintf(stderr, "%s\n", qPrintable(msg));
+
 	if (type == QtFatalMsg)
 		abort();
 }
 
-static QList<QSharedPointer<RawError>>
-parseFile(QFile& logFile, const QString& buildRoot)
+// QC: Show lines that aren't recorded in the database
+static void
+showUnrecordedLines(const LogParser& parser, const QString& logFilename)
 {
-	QStringList mainStuff;
-	QStringList otherStuff;
+	auto leftOvers = new UnrecordedLinesViewer(parser.unrecordedLines(), logFilename);
 
-	bool bodyStarted = false;
-	while (!logFile.atEnd())
-	{
-		QString line = logFile.readLine();
-		line.remove('\n');
-		if (line.isEmpty())
-			continue;
+	if (parser.buildRootDetected())
+		leftOvers->setWindowTitle(leftOvers->windowTitle() + " (Detected build root: " + parser.buildRoot() + ')');
 
-		if (!bodyStarted)
-		{
-			if (line.startsWith(buildRoot))
-			{
-				bodyStarted = true;
-				mainStuff << line.remove(buildRoot);
-			}
-			else
-				otherStuff << line;
-		}
-		else
-		{
-			if (line.startsWith(buildRoot))
-				mainStuff << line.remove(buildRoot);
-			else if (line.startsWith("    "))
-				mainStuff.last().append('\n' + line);
-			else
-				otherStuff << line;
-		}
-	}
+	leftOvers->show();
+}
 
-	QList<QSharedPointer<RawError>> entries;
-	for (const QString& rawLine : mainStuff)
-	{
-		// Expect a format like
-		// "C:/Qt/git/5.x.y/qtxmlpatterns/examples/xmlpatterns/xquery/doc/src/globalVariables.qdoc:28: warning:   EXAMPLE PATH DOES NOT EXIST: xmlpatterns/xquery/globalVariables"
+// cd into the folder which contains the database file and the settings file
+static void
+enterDataFolder()
+{
+	QString dataPath = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+	QDir dir;
+	dir.mkpath(dataPath);
+	QDir::setCurrent(dataPath);
+}
 
-		RawError* entry = new RawError;
-		QStringList tokens = rawLine.split(": ");
-		if (tokens.count() < 3)
-		{
-			QMessageBox::warning(nullptr, "Cannot parse line", rawLine);
-			delete entry;
-			continue;
-		}
+static QString
+socketName(const QSettings& settings)
+{
+	return settings.value("ServerSocket", QDir::current().absoluteFilePath("qdocerrortracker.sock")).toString();
+}
 
-		QStringList fileInfo = tokens[0].split(':');
-		if (fileInfo.count() < 2)
-			entry->line = -1;
-		else
-			entry->line = fileInfo[1].toInt();
+// Headless mode: Answer queries from other processes (see QueryServer)
+static int
+serve(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	enterDataFolder();
 
-		entry->repo = fileInfo[0].split('/').first();
-		entry->file = fileInfo[0].remove(entry->repo + '/');
+	Database db("data.db", Database::ReadOnly);
+	QSettings settings("qdocerrortracker.ini", QSettings::IniFormat);
 
-		// Handle cases where the error message contains ": "
-		entry->message = tokens[1];
-		for (int i = 2; i < tokens.count(); ++i)
-			entry->message += ": " + tokens[i];
+	QueryServer server(&db);
+	if (!server.listen(socketName(settings)))
+		return 1;
 
-		entries << QSharedPointer<RawError>(entry);
-	}
+	fprintf(stderr, "Listening on %s\n", qPrintable(socketName(settings)));
+	return a.exec();
+}
 
-	// QC: Show lines that aren't recorded in the database
-	QTextEdit* leftOvers = new QTextEdit;
-	for (const QString& line : otherStuff)
-		leftOvers->append(line);
+// Sends the requests (or the lines of stdin, for "-") to a running server
+static int
+query(int argc, char *argv[], const QStringList& requests)
+{
+	QCoreApplication a(argc, argv);
+	enterDataFolder();
 
-	leftOvers->setWindowTitle("Unrecorded Lines");
-	leftOvers->setAttribute(Qt::WA_DeleteOnClose);
-	leftOvers->setReadOnly(true);
-	leftOvers->resize(600, 480);
-	leftOvers->show();
+	QStringList lines = requests;
+	if (lines == QStringList("-"))
+	{
+		lines.clear();
+
+		QFile in;
+		in.open(stdin, QFile::ReadOnly|QFile::Text);
+		while (!in.atEnd())
+		{
+			QString line = QString::fromUtf8(in.readLine()).trimmed();
+			if (!line.isEmpty())
+				lines << line;
+		}
+	}
 
-	return entries;
+	QSettings settings("qdocerrortracker.ini", QSettings::IniFormat);
+	return QueryServer::query(socketName(settings), lines);
 }
 
 int main(int argc, char *argv[])
 {
 	qInstallMessageHandler(popupWarning);
-	QApplication a(argc, argv);
 
-	// cd into the folder which contains the database file and the settings file
-	QString dataPath = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
-	QDir dir;
-	dir.mkpath(dataPath);
-	QDir::setCurrent(dataPath);
+	// Usage: QDocErrorTracker --serve
+	//        QDocErrorTracker --query <JSON request>... | -
+	if (argc > 1 && qstrcmp(argv[1], "--serve") == 0)
+		return serve(argc, argv);
+	if (argc > 2 && qstrcmp(argv[1], "--query") == 0)
+	{
+		QStringList requests;
+		for (int i = 2; i < argc; ++i)
+			requests << QString::fromLocal8Bit(argv[i]);
+		return query(argc, argv, requests);
+	}
+
+	QApplication a(argc, argv);
+	enterDataFolder();
 
 	Gui gui;
 	Database db("data.db");
 
+	QSettings settings("qdocerrortracker.ini", QSettings::IniFormat);
+	db.setSnapshotInterval(settings.value("SnapshotInterval", 10).toInt());
+	db.setCacheBudget(settings.value("CacheBudgetMB", 256).toInt());
+
 	// Upon user selection, parse the log file and add entries to the database
 	QObject::connect(&gui, &Gui::newFileSelected, [&](const QString& logFilename,
 			const QString& buildRoot, const QDateTime& timestamp, const QString& comments)
@@ -124,17 +139,19 @@ int main(int argc, char *argv[])
 			return;
 		}
 
-		auto entries = parseFile(logFile, buildRoot);
-		if (entries.size() == 0)
+		LogParser parser(buildRoot);
+		ParsedLog log = parser.parse(logFile);
+		showUnrecordedLines(parser, logFilename);
+		if (log.count() == 0)
 		{
 			QMessageBox::warning(nullptr, "Warning",
 					"No entries found. Please check that you have selected "
-					"the correct log file and its corresponding build root.");
+					"the correct log file.");
 
 			return;
 		}
 
-		db.addSession({timestamp, comments, entries});
+		db.addSession({timestamp, comments, log, parser.unrecordedLines()});
 	});
 
 	// When the user clicks on either of the session lists, fetch the corresponding
@@ -151,13 +168,72 @@ int main(int argc, char *argv[])
 		}
 	});
 
+	QObject::connect(&gui, &Gui::fuzzyMatchingToggled,
+			&db, &Database::setFuzzyMatching);
+
+	QObject::connect(&gui, &Gui::matrixRequested,
+			&db, &Database::setMatrixSessions);
+	QObject::connect(&gui, &Gui::matrixFilterChanged, [&](int filter, int n)
+	{
+		db.setMatrixFilter(Database::PresenceFilter(filter), n);
+	});
+
+	QObject::connect(&gui, &Gui::summarySelectionChanged, [&](const QString& s1, const QString& s2)
+	{
+		if (!s1.isEmpty())
+			db.setSummaryModel(s1, s2);
+	});
+
 	QObject::connect(&gui, &Gui::deletionRequested,
 			&db, &Database::removeSession);
 
+	// Show the summary of the lines that weren't recorded when the session was imported
+	QObject::connect(&gui, &Gui::unrecordedLinesRequested, [&](const QString& session)
+	{
+		auto leftOvers = new UnrecordedLinesViewer(db.unrecordedLines(session));
+		leftOvers->setWindowTitle(leftOvers->windowTitle() + " - " + session);
+		leftOvers->show();
+	});
+
+	QObject::connect(&gui, &Gui::snapshotExportRequested, [&](const QString& session, const QString& filename)
+	{
+		db.exportSnapshot(session, filename);
+	});
+
+	// Snapshots are viewed without adding them to the database
+	QObject::connect(&gui, &Gui::snapshotOpenRequested, [&](const QString& filename)
+	{
+		QSharedPointer<SessionSnapshot> snapshot(new SessionSnapshot(filename));
+		if (!snapshot->isValid())
+		{
+			QMessageBox::warning(nullptr, "Error", "Can't open " + filename + ": " + snapshot->errorString());
+			return;
+		}
+
+		(new SnapshotViewer(snapshot))->show();
+	});
+
+	// Bulk annotation
+	QObject::connect(&gui, &Gui::annotationRequested, [&](const QList<int>& errorIds, const QString& notes)
+	{
+		db.annotateErrors(errorIds, notes);
+	});
+	QObject::connect(&gui, &Gui::matchingAnnotationRequested, [&](const QString& pathPattern,
+			const QString& messagePattern, const QString& notes)
+	{
+		int count = db.annotateMatching(pathPattern, messagePattern, notes);
+		if (count == 0)
+			QMessageBox::information(nullptr, "Annotate Matching Errors", "No errors match the given patterns.");
+	});
+
 	// Populate + show GUI
+	gui.setCategoryNames(MessageClassifier::categoryNames());
 	gui.setSessionLists(db.sessionListModel());
 	gui.setFullModel(db.fullModel());
 	gui.setDiffModels(db.diffModel_L(), db.diffModel_R());
+	gui.setMatchModel(db.matchModel());
+	gui.setMatrixModel(db.matrixModel());
+	gui.setSummaryModel(db.summaryModel());
 	gui.show();
 
 	return a.exec();
@@ -0,0 +1,178 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "messageclassifier.h"
+#include "hashing.h"
+#include <QQueue>
+
+// Keywords are matched case-insensitively. If a message matches multiple
+// categories, the earliest one wins.
+static const struct
+{
+	const char* name;
+	const char* keywords[8];
+} rules[] = {
+	{"Unresolved link", {"can't link to", "cannot link to", "unresolved link", "no such target", nullptr}},
+	{"Missing example or file", {"example path does not exist", "cannot find file", "cannot find example",
+			"cannot find quote", "no such file", nullptr}},
+	{"Missing image", {"missing image", "cannot find image", "image not found", nullptr}},
+	{"Parameter documentation", {"undocumented parameter", "no such parameter", "undocumented return value", nullptr}},
+	{"Reimplementation", {"cannot find base function", "\\reimp", nullptr}},
+	{"Unattached documentation", {"cannot tie this documentation", "cannot find '", "specified with '\\fn'",
+			"invalid syntax in '\\fn'", "unknown function", nullptr}},
+	{"Undocumented", {"no documentation for", "is not documented", "undocumented", nullptr}},
+	{"Markup error", {"unknown command", "unknown macro", "missing '\\", "unexpected '\\",
+			"failed at end of file", "unbalanced", "can't close", nullptr}},
+	{"Duplicate documentation", {"duplicate", "already documented", "already has documentation", nullptr}},
+	{"Obsolete", {"obsolete", "deprecated", nullptr}}
+};
+
+static const int ruleCount = sizeof(rules) / sizeof(rules[0]);
+
+// Bump this when classify() changes the way it matches
+static const int matchingVersion = 2;
+
+// Maps characters to the automaton's alphabet. Everything that isn't ASCII
+// is mapped to 0, which doesn't appear in any keyword.
+static inline int
+symbol(ushort c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 'a';
+	return (c < 128) ? c : 0;
+}
+
+const MessageClassifier&
+MessageClassifier::instance()
+{
+	static const MessageClassifier classifier;
+	return classifier;
+}
+
+MessageClassifier::MessageClassifier()
+{
+	// Build a trie of the keywords. State 0 is the root.
+	addState();
+	for (int r = 0; r < ruleCount; ++r)
+	{
+		for (const char* const* keyword = rules[r].keywords; *keyword; ++keyword)
+		{
+			int state = 0;
+			for (const char* c = *keyword; *c; ++c)
+			{
+				// addState() reallocates the table, so don't hold a reference into it
+				int index = state*AlphabetSize + symbol(uchar(*c));
+				if (_transitions[index] == 0)
+				{
+					int next = addState();
+					_transitions[index] = next;
+				}
+				state = _transitions[index];
+			}
+
+			// Category 0 is for messages that don't match any rule
+			int category = r + 1;
+			if (_categories[state] == OtherCategory || category < _categories[state])
+				_categories[state] = category;
+		}
+	}
+
+	// Turn the trie into an automaton: Breadth-first, point each missing
+	// transition to where the failure link would lead, and inherit the
+	// categories of the keywords which are suffixes of this state's text
+	QVector<int> failureLinks(_categories.size(), 0);
+	QQueue<int> queue;
+	for (int c = 0; c < AlphabetSize; ++c)
+	{
+		if (_transitions[c] != 0)
+			queue.enqueue(_transitions[c]);
+	}
+	while (!queue.isEmpty())
+	{
+		int state = queue.dequeue();
+
+		int inherited = _categories[failureLinks[state]];
+		if (inherited != OtherCategory
+				&& (_categories[state] == OtherCategory || inherited < _categories[state]))
+		{
+			_categories[state] = inherited;
+		}
+
+		for (int c = 0; c < AlphabetSize; ++c)
+		{
+			int& next = _transitions[state*AlphabetSize + c];
+			int fallback = _transitions[failureLinks[state]*AlphabetSize + c];
+			if (next == 0)
+				next = fallback;
+			else
+			{
+				failureLinks[next] = fallback;
+				queue.enqueue(next);
+			}
+		}
+	}
+}
+
+int
+MessageClassifier::classify(const QStringRef& message) const
+{
+	const QChar* data = message.unicode();
+	int state = 0;
+	int category = OtherCategory;
+	for (int i = 0; i < message.size() && data[i] != QLatin1Char('\n'); ++i)
+	{
+		state = _transitions[state*AlphabetSize + symbol(data[i].unicode())];
+
+		int found = _categories[state];
+		if (found != OtherCategory && (category == OtherCategory || found < category))
+		{
+			category = found;
+
+			// Nothing can beat the first rule
+			if (category == 1)
+				break;
+		}
+	}
+	return category;
+}
+
+QStringList
+MessageClassifier::categoryNames()
+{
+	QStringList names;
+	names << "Other";
+	for (int r = 0; r < ruleCount; ++r)
+		names << rules[r].name;
+	return names;
+}
+
+QString
+MessageClassifier::categoryName(int category)
+{
+	if (category <= OtherCategory || category > ruleCount)
+		return "Other";
+	return rules[category - 1].name;
+}
+
+quint64
+MessageClassifier::fingerprint()
+{
+	// Names and keywords are separated by their terminating null characters
+	quint64 hash = hashBytes(&matchingVersion, int(sizeof(matchingVersion)));
+	for (int r = 0; r < ruleCount; ++r)
+	{
+		hash = hashBytes(rules[r].name, int(qstrlen(rules[r].name)) + 1, hash);
+		for (const char* const* keyword = rules[r].keywords; *keyword; ++keyword)
+			hash = hashBytes(*keyword, int(qstrlen(*keyword)) + 1, hash);
+		hash = hashBytes("", 1, hash);
+	}
+	return hash;
+}
+
+int
+MessageClassifier::addState()
+{
+	_transitions.insert(_transitions.size(), AlphabetSize, 0);
+	_categories << OtherCategory;
+	return _categories.size() - 1;
+}
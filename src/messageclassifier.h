@@ -0,0 +1,47 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef MESSAGECLASSIFIER_H
+#define MESSAGECLASSIFIER_H
+
+#include <QStringList>
+#include <QVector>
+
+// Sorts QDoc warnings into categories by looking for keywords. All keywords
+// are compiled into one automaton (Aho-Corasick), so each message is scanned
+// once, regardless of the number of rules.
+class MessageClassifier
+{
+public:
+	enum { OtherCategory = 0 };
+
+	static const MessageClassifier& instance(); // Compiled on first use
+
+	// Only the first line is classified. Continuation lines only add context,
+	// and they are appended to the message after it has been classified.
+	int classify(const QStringRef& message) const;
+
+	// Category IDs are the indices of the names
+	static QStringList categoryNames();
+	static QString categoryName(int category);
+
+	// Changes whenever the rules or the matching change, so that stored
+	// categories can be checked
+	static quint64 fingerprint();
+
+private:
+	MessageClassifier();
+
+	enum { AlphabetSize = 128 }; // Keywords are ASCII only
+
+	int addState();
+
+	// Complete transition table: _transitions[state*AlphabetSize + c]
+	QVector<int> _transitions;
+
+	// The highest-priority category of the keywords that end at each state,
+	// or 0 if there are none
+	QVector<int> _categories;
+};
+
+#endif // MESSAGECLASSIFIER_H
@@ -0,0 +1,126 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "minhash.h"
+#include "hashing.h"
+#include <QtEndian>
+#include <QHash>
+#include <algorithm>
+
+static const int shingleSize = 4;
+
+// Comparing against a huge bucket would be quadratic again. Such buckets come
+// from many near-identical errors, which couldn't be paired reliably anyway.
+static const int maxBucketSize = 256;
+
+QByteArray
+MinHash::signature(const QString& text)
+{
+	QString normalized = text.toLower();
+	int length = qMin(shingleSize, normalized.size());
+	int shingleCount = qMax(1, normalized.size() - shingleSize + 1);
+
+	quint32 mins[HashCount];
+	std::fill(mins, mins + HashCount, 0xffffffff);
+	for (int s = 0; s < shingleCount; ++s)
+	{
+		// Derive all of the hash functions from 2 hashes of the shingle
+		quint64 hash1 = mix(hashBytes(normalized.constData() + s, length * sizeof(QChar)));
+		quint64 hash2 = mix(hash1) | 1;
+		for (int h = 0; h < HashCount; ++h)
+		{
+			quint32 value = quint32((hash1 + h*hash2) >> 32);
+			if (value < mins[h])
+				mins[h] = value;
+		}
+	}
+
+	// Store in a fixed byte order, so that databases can be moved between machines
+	for (int h = 0; h < HashCount; ++h)
+		mins[h] = qToLittleEndian(mins[h]);
+	return QByteArray(reinterpret_cast<const char*>(mins), SignatureSize);
+}
+
+double
+MinHash::similarity(const QByteArray& signature1, const QByteArray& signature2)
+{
+	if (signature1.size() != SignatureSize || signature2.size() != SignatureSize)
+		return 0;
+
+	auto values1 = reinterpret_cast<const quint32*>(signature1.constData());
+	auto values2 = reinterpret_cast<const quint32*>(signature2.constData());
+	int matches = 0;
+	for (int h = 0; h < HashCount; ++h)
+	{
+		if (values1[h] == values2[h])
+			++matches;
+	}
+	return double(matches) / HashCount;
+}
+
+// Signatures that share a band key are likely to be similar
+static quint64
+bandKey(const QByteArray& signature, int band)
+{
+	const int bandSize = MinHash::SignatureSize / MinHash::BandCount;
+	return hashBytes(signature.constData() + band*bandSize, bandSize, mix(band + 1));
+}
+
+QVector<MinHash::Match>
+MinHash::matchPairs(const QVector<QByteArray>& left, const QVector<QByteArray>& right, double threshold)
+{
+	QHash<quint64, QVector<int>> buckets;
+	for (int l = 0; l < left.size(); ++l)
+	{
+		if (left[l].size() != SignatureSize)
+			continue;
+		for (int b = 0; b < BandCount; ++b)
+			buckets[bandKey(left[l], b)] << l;
+	}
+
+	QVector<Match> candidates;
+	QVector<int> comparedWith(left.size(), -1); // Don't compare the same pair in multiple bands
+	for (int r = 0; r < right.size(); ++r)
+	{
+		if (right[r].size() != SignatureSize)
+			continue;
+
+		for (int b = 0; b < BandCount; ++b)
+		{
+			auto bucket = buckets.constFind(bandKey(right[r], b));
+			if (bucket == buckets.constEnd() || bucket->size() > maxBucketSize)
+				continue;
+
+			for (int l : *bucket)
+			{
+				if (comparedWith[l] == r)
+					continue;
+				comparedWith[l] = r;
+
+				double s = similarity(left[l], right[r]);
+				if (s >= threshold)
+					candidates << Match{l, r, s};
+			}
+		}
+	}
+
+	// Greedily take the most similar pairs
+	std::stable_sort(candidates.begin(), candidates.end(), [](const Match& a, const Match& b)
+	{
+		return a.similarity > b.similarity;
+	});
+
+	QVector<bool> leftUsed(left.size(), false);
+	QVector<bool> rightUsed(right.size(), false);
+	QVector<Match> matches;
+	for (const Match& match : candidates)
+	{
+		if (leftUsed[match.left] || rightUsed[match.right])
+			continue;
+
+		leftUsed[match.left] = true;
+		rightUsed[match.right] = true;
+		matches << match;
+	}
+	return matches;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// MinHash signatures estimate how similar two strings are (the Jaccard index
+// of their sets of character shingles), without looking at the strings again.
+class MinHash
+{
+public:
+	enum
+	{
+		HashCount = 32,
+
+		// For locality-sensitive hashing: 16 bands of 2 hashes each. A pair
+		// with similarity s shares a band with probability 1 - (1 - s^2)^16,
+		// so about 0.1% of the pairs at the 0.6 threshold are missed (8 bands
+		// of 4 hashes would miss a third of them).
+		BandCount = 16,
+		SignatureSize = HashCount * 4 // Bytes
+	};
+
+	struct Match
+	{
+		int left;  // Index into the left signatures
+		int right; // Index into the right signatures
+		double similarity;
+	};
+
+	static QByteArray signature(const QString& text);
+	static double similarity(const QByteArray& signature1, const QByteArray& signature2);
+
+	// Pairs up left and right signatures that are at least `threshold` similar.
+	// Each signature is used once at most, and the most similar pairs win.
+	// Only the signatures that share a band are compared, so that the cost
+	// grows with the number of signatures, not the number of pairs.
+	static QVector<Match> matchPairs(const QVector<QByteArray>& left,
+			const QVector<QByteArray>& right, double threshold);
+};
+
+#endif // MINHASH_H
@@ -0,0 +1,156 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "parsedlog.h"
+#include "hashing.h"
+#include <QHash>
+
+quint64
+ParsedLog::errorHash(const QStringRef& repo, const QStringRef& file, const QStringRef& message)
+{
+	// Must match the entry hashes in setBuildRoot()
+	return hashString(message, hashString(file, hashString(repo) ^ '/') ^ ':');
+}
+
+void
+ParsedLog::append(const QStringRef& path, int line, const QStringRef& message, int category)
+{
+	// Consecutive entries usually come from the same file
+	int fileIndex = -1;
+	if (!_fileOffsets.isEmpty() && file(_lastFile) == path)
+		fileIndex = _lastFile;
+	else
+	{
+		uint key = qHash(path);
+		for (auto it = _fileLookup.constFind(key); it != _fileLookup.constEnd() && it.key() == key; ++it)
+		{
+			if (file(it.value()) == path)
+			{
+				fileIndex = it.value();
+				break;
+			}
+		}
+
+		if (fileIndex < 0)
+		{
+			fileIndex = _fileOffsets.size();
+			_fileOffsets << _arena.size();
+			_fileLengths << path.size();
+			_fileRepos << -1;
+			_fileLookup.insert(key, fileIndex);
+			_arena.append(path);
+		}
+		_lastFile = fileIndex;
+	}
+
+	_fileIndices << fileIndex;
+	_lines << line;
+	_msgOffsets << _arena.size();
+	_msgLengths << message.size();
+	_categories << category;
+	_arena.append(message);
+}
+
+void
+ParsedLog::appendToLastMessage(const QString& text)
+{
+	// The last message is always at the end of the arena
+	_arena.append(text);
+	_msgLengths.last() += text.size();
+}
+
+void
+ParsedLog::setBuildRoot(const QString& buildRoot)
+{
+	if (!buildRoot.isEmpty())
+		removeEntriesOutside(buildRoot);
+
+	// Split the paths into repos and files. The first directory
+	// below the build root is the repo.
+	QHash<QString, int> repoLookup;
+	for (int f = 0; f < fileCount(); ++f)
+	{
+		QStringRef path = file(f);
+		if (!buildRoot.isEmpty() && path.startsWith(buildRoot))
+			path = _arena.midRef(_fileOffsets[f] + buildRoot.size(), path.size() - buildRoot.size());
+
+		int sep = path.indexOf('/');
+		QStringRef repoName = _arena.midRef(path.position(), qMax(sep, 0));
+
+		int repoIndex = repoLookup.value(repoName.toString(), -1);
+		if (repoIndex < 0)
+		{
+			repoIndex = _repoOffsets.size();
+			_repoOffsets << repoName.position();
+			_repoLengths << repoName.size();
+			repoLookup[repoName.toString()] = repoIndex;
+		}
+
+		_fileRepos[f] = repoIndex;
+		_fileOffsets[f] = path.position() + sep + 1;
+		_fileLengths[f] = path.size() - sep - 1;
+	}
+	_fileLookup.clear();
+
+	// Hash the normalized entries
+	QVector<quint64> fileHashes(fileCount());
+	for (int f = 0; f < fileCount(); ++f)
+		fileHashes[f] = hashString(file(f), hashString(repo(repoIndex(f))) ^ '/');
+
+	// The entry hashes are scrambled so that they can be summed up without
+	// the entries cancelling each other out
+	_hash = 0;
+	for (int i = 0; i < count(); ++i)
+	{
+		quint64 hash = hashString(message(i), fileHashes[fileIndex(i)] ^ ':');
+		_hash += mix(hash ^ quint32(line(i)));
+	}
+	_hash = mix(_hash ^ count());
+}
+
+// Removes the files that don't start with the build root, and their entries.
+// Their strings are left in the arena.
+void
+ParsedLog::removeEntriesOutside(const QString& buildRoot)
+{
+	QVector<int> newFileIndices(fileCount(), -1);
+	int keptFiles = 0;
+	for (int f = 0; f < fileCount(); ++f)
+	{
+		if (!file(f).startsWith(buildRoot))
+			continue;
+
+		newFileIndices[f] = keptFiles;
+		_fileOffsets[keptFiles] = _fileOffsets[f];
+		_fileLengths[keptFiles] = _fileLengths[f];
+		++keptFiles;
+	}
+	if (keptFiles == fileCount())
+		return;
+
+	_fileOffsets.resize(keptFiles);
+	_fileLengths.resize(keptFiles);
+	_fileRepos.resize(keptFiles);
+	_lastFile = 0;
+
+	int keptEntries = 0;
+	for (int i = 0; i < count(); ++i)
+	{
+		int fileIndex = newFileIndices[_fileIndices[i]];
+		if (fileIndex < 0)
+			continue;
+
+		_fileIndices[keptEntries] = fileIndex;
+		_lines[keptEntries] = _lines[i];
+		_msgOffsets[keptEntries] = _msgOffsets[i];
+		_msgLengths[keptEntries] = _msgLengths[i];
+		_categories[keptEntries] = _categories[i];
+		++keptEntries;
+	}
+
+	_fileIndices.resize(keptEntries);
+	_lines.resize(keptEntries);
+	_msgOffsets.resize(keptEntries);
+	_msgLengths.resize(keptEntries);
+	_categories.resize(keptEntries);
+}
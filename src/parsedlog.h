@@ -0,0 +1,72 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef PARSEDLOG_H
+#define PARSEDLOG_H
+
+#include <QString>
+#include <QVector>
+#include <QMultiHash>
+
+// Compact storage for the entries of a log. All strings live in one arena.
+// Files and repos are interned, and the entries are stored column by column.
+class ParsedLog
+{
+public:
+	ParsedLog() : _lastFile(0), _hash(0) {}
+
+	// Building the log. The paths passed to append() are split into repo and
+	// file by setBuildRoot(), after all entries have been appended. Entries
+	// outside a non-empty build root are removed.
+	void append(const QStringRef& path, int line, const QStringRef& message, int category = 0);
+	void appendToLastMessage(const QString& text);
+	void setBuildRoot(const QString& buildRoot);
+
+	// Entries
+	int count() const {return _lines.size();}
+	int fileIndex(int i) const {return _fileIndices[i];}
+	int line(int i) const {return _lines[i];}
+	QStringRef message(int i) const {return _arena.midRef(_msgOffsets[i], _msgLengths[i]);}
+	int category(int i) const {return _categories[i];} // See MessageClassifier
+
+	// Interned files and repos
+	int fileCount() const {return _fileOffsets.size();}
+	QStringRef file(int fileIndex) const {return _arena.midRef(_fileOffsets[fileIndex], _fileLengths[fileIndex]);}
+	int repoIndex(int fileIndex) const {return _fileRepos[fileIndex];}
+	int repoCount() const {return _repoOffsets.size();}
+	QStringRef repo(int repoIndex) const {return _arena.midRef(_repoOffsets[repoIndex], _repoLengths[repoIndex]);}
+
+	// Identical logs produce identical hashes, regardless of the order of the
+	// entries or the location of the build root. Valid after setBuildRoot().
+	quint64 hash() const {return _hash;}
+
+	// Identifies an error by its content, independently of any database
+	static quint64 errorHash(const QStringRef& repo, const QStringRef& file, const QStringRef& message);
+
+private:
+	void removeEntriesOutside(const QString& buildRoot);
+
+	QString _arena;
+
+	// Per entry
+	QVector<int> _fileIndices;
+	QVector<int> _lines;
+	QVector<int> _msgOffsets;
+	QVector<int> _msgLengths;
+	QVector<quint8> _categories;
+
+	// Per file
+	QVector<int> _fileOffsets;
+	QVector<int> _fileLengths;
+	QVector<int> _fileRepos;
+	QMultiHash<uint, int> _fileLookup; // qHash(path) -> File index
+	int _lastFile;
+
+	// Per repo
+	QVector<int> _repoOffsets;
+	QVector<int> _repoLengths;
+
+	quint64 _hash;
+};
+
+#endif // PARSEDLOG_H
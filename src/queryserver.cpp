@@ -0,0 +1,525 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "queryserver.h"
+#include "database.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadStorage>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+#include <cstdio>
+#include <functional>
+
+// Longest request that is accepted, in bytes
+static const int maxRequestSize = 1024*1024;
+
+typedef std::function<QJsonValue(QSqlDatabase& db, QString* error)> QueryFunction;
+
+static QByteArray
+response(const QJsonValue& requestId, const QJsonValue& result, const QString& error)
+{
+	QJsonObject response;
+	if (!requestId.isUndefined())
+		response["id"] = requestId;
+
+	response["ok"] = error.isEmpty();
+	if (error.isEmpty())
+		response["result"] = result;
+	else
+		response["error"] = error;
+
+	return QJsonDocument(response).toJson(QJsonDocument::Compact) + '\n';
+}
+
+//======================================================================
+// READCONNECTION
+//======================================================================
+// The connection of a pooled thread. It stays open until the thread exits.
+class ReadConnection
+{
+public:
+	explicit ReadConnection(const QString& sqliteFile)
+		: _db(QSqlDatabase::addDatabase("QSQLITE",
+				QString("QueryServer-%1").arg(quintptr(QThread::currentThreadId()))))
+	{
+		_db.setDatabaseName(sqliteFile);
+		_db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=5000");
+		if (!_db.open())
+			qWarning() << "Opening read connection:" << _db.lastError().text();
+	}
+
+	~ReadConnection()
+	{
+		QString connectionName = _db.connectionName();
+		_db.close();
+		_db = QSqlDatabase();
+		QSqlDatabase::removeDatabase(connectionName);
+	}
+
+	QSqlDatabase& db() {return _db;}
+
+private:
+	QSqlDatabase _db;
+};
+
+static QThreadStorage<ReadConnection*> readConnections;
+
+//======================================================================
+// QUERYTASK
+//======================================================================
+class QueryTask : public QRunnable
+{
+public:
+	QueryTask(QueryServer* server, int clientId, const QJsonValue& requestId,
+			const QString& sqliteFile, const QueryFunction& function)
+		: _server(server)
+		, _clientId(clientId)
+		, _requestId(requestId)
+		, _sqliteFile(sqliteFile)
+		, _function(function)
+	{}
+
+	void run()
+	{
+		if (!readConnections.hasLocalData())
+			readConnections.setLocalData(new ReadConnection(_sqliteFile));
+
+		QString error;
+		QJsonValue result = _function(readConnections.localData()->db(), &error);
+
+		QMetaObject::invokeMethod(_server, "sendResponse", Qt::QueuedConnection,
+				Q_ARG(int, _clientId),
+				Q_ARG(QByteArray, response(_requestId, result, error)));
+	}
+
+private:
+	QueryServer* _server;
+	int _clientId;
+	QJsonValue _requestId;
+	QString _sqliteFile;
+	QueryFunction _function;
+};
+
+//======================================================================
+// QUERIES
+//======================================================================
+// Counts the errors in the rows of a session, grouped by repo and by category
+static QJsonValue
+summarize(QSqlDatabase& db, const QString& rowSelection, QString* error)
+{
+	QSqlQuery q(db);
+	q.setForwardOnly(true);
+	if (!q.exec("SELECT Repos.repo,COUNT(*) FROM (" + rowSelection + ") AS Main "
+			"JOIN Errors ON Errors.id=Main.error "
+			"JOIN Files ON Files.id=Errors.file "
+			"JOIN Repos ON Repos.id=Files.repo "
+			"GROUP BY Files.repo"))
+	{
+		*error = q.lastError().text();
+		return QJsonValue();
+	}
+
+	QJsonArray repos;
+	int total = 0;
+	while (q.next())
+	{
+		QJsonObject repo;
+		repo["repo"] = q.value(0).toString();
+		repo["count"] = q.value(1).toInt();
+		repos.append(repo);
+
+		total += q.value(1).toInt();
+	}
+
+	q.finish();
+
+	// Categories are stored as IDs, so this is just an indexed lookup
+	if (!q.exec("SELECT Categories.name,COUNT(*) FROM (" + rowSelection + ") AS Main "
+			"JOIN Errors ON Errors.id=Main.error "
+			"JOIN Messages ON Messages.id=Errors.message "
+			"JOIN Categories ON Categories.id=Messages.category "
+			"GROUP BY Messages.category"))
+	{
+		*error = q.lastError().text();
+		return QJsonValue();
+	}
+
+	QJsonObject categories;
+	while (q.next())
+		categories[q.value(0).toString()] = q.value(1).toInt();
+
+	QJsonObject summary;
+	summary["count"] = total;
+	summary["repos"] = repos;
+	summary["categories"] = categories;
+	return summary;
+}
+
+static QJsonValue
+listRows(QSqlDatabase& db, const QString& rowSelection, QString* error)
+{
+	QSqlQuery q(db);
+	q.setForwardOnly(true);
+	if (!q.exec("SELECT Main.error,Repos.repo,Files.file,Main.line,Messages.message,Errors.notes "
+			"FROM (" + rowSelection + ") AS Main "
+			"JOIN Errors ON Errors.id=Main.error "
+			"JOIN Files ON Files.id=Errors.file "
+			"JOIN Repos ON Repos.id=Files.repo "
+			"JOIN Messages ON Messages.id=Errors.message"))
+	{
+		*error = q.lastError().text();
+		return QJsonValue();
+	}
+
+	QJsonArray rows;
+	while (q.next())
+	{
+		QJsonObject row;
+		row["error"] = q.value(0).toInt();
+		row["repo"] = q.value(1).toString();
+		row["file"] = q.value(2).toString();
+		row["line"] = q.value(3).toInt();
+		row["message"] = q.value(4).toString();
+		row["notes"] = q.value(5).toString();
+		rows.append(row);
+	}
+	return rows;
+}
+
+// Finds the sessions that contain an error. Delta-encoded sessions contain
+// their own rows, plus the rows of their base which they haven't removed.
+// Aliases contain the rows of the session that they point to.
+static QJsonValue
+history(QSqlDatabase& db, int errorId, const QString& path, const QString& message,
+		const QMap<int, QString>& sessionNames, QString* error)
+{
+	QSqlQuery q(db);
+	q.setForwardOnly(true);
+	if (errorId > 0)
+	{
+		q.prepare("SELECT Errors.id,Repos.repo||'/'||Files.file,Messages.message,Errors.notes FROM Errors "
+				"JOIN Files ON Files.id=Errors.file "
+				"JOIN Repos ON Repos.id=Files.repo "
+				"JOIN Messages ON Messages.id=Errors.message "
+				"WHERE Errors.id=?");
+		q.addBindValue(errorId);
+	}
+	else
+	{
+		q.prepare("SELECT Errors.id,Repos.repo||'/'||Files.file,Messages.message,Errors.notes FROM Errors "
+				"JOIN Files ON Files.id=Errors.file "
+				"JOIN Repos ON Repos.id=Files.repo "
+				"JOIN Messages ON Messages.id=Errors.message "
+				"WHERE Repos.repo||'/'||Files.file=? AND Messages.message=?");
+		q.addBindValue(path);
+		q.addBindValue(message);
+	}
+	if (!q.exec())
+	{
+		*error = q.lastError().text();
+		return QJsonValue();
+	}
+	if (!q.next())
+	{
+		*error = "Unknown error";
+		return QJsonValue();
+	}
+
+	QJsonObject result;
+	errorId = q.value(0).toInt();
+	result["error"] = errorId;
+	result["path"] = q.value(1).toString();
+	result["message"] = q.value(2).toString();
+	result["notes"] = q.value(3).toString();
+	q.finish();
+
+	q.prepare("SELECT Sessions.id FROM Sessions "
+			"JOIN Sessions AS Data ON Data.id=IFNULL(NULLIF(Sessions.alias,0),Sessions.id) "
+			"WHERE EXISTS (SELECT 1 FROM Main WHERE Main.session=Data.id AND Main.error=?) "
+			"OR (IFNULL(Data.base,0)<>0 AND EXISTS (SELECT 1 FROM Main WHERE Main.session=Data.base AND Main.error=? "
+			"AND NOT EXISTS (SELECT 1 FROM Removed WHERE Removed.session=Data.id "
+			"AND Removed.error=Main.error AND Removed.line=Main.line))) "
+			"ORDER BY Sessions.timestamp");
+	q.addBindValue(errorId);
+	q.addBindValue(errorId);
+	if (!q.exec())
+	{
+		*error = q.lastError().text();
+		return QJsonValue();
+	}
+
+	QJsonArray sessions;
+	while (q.next())
+	{
+		// Sessions that were added after the last refresh don't have names yet
+		int sessionId = q.value(0).toInt();
+		if (sessionNames.contains(sessionId))
+			sessions.append(sessionNames[sessionId]);
+	}
+
+	result["sessions"] = sessions;
+	if (!sessions.isEmpty())
+	{
+		result["firstSeen"] = sessions.first();
+		result["lastSeen"] = sessions.last();
+	}
+	return result;
+}
+
+//======================================================================
+// QUERYSERVER
+//======================================================================
+/**********************************************************************\
+ * CONSTRUCTOR/DESTRUCTOR
+\**********************************************************************/
+QueryServer::QueryServer(Database* database, QObject* parent)
+	: QObject(parent)
+	, _database(database)
+	, _server(new QLocalServer(this))
+	, _nextClientId(1)
+{
+	// Keep the pooled threads (and their connections) alive
+	_pool.setExpiryTimeout(-1);
+
+	connect(_server, &QLocalServer::newConnection,
+			this, &QueryServer::acceptConnections);
+}
+
+QueryServer::~QueryServer()
+{
+	_pool.waitForDone();
+}
+
+/**********************************************************************\
+ * PUBLIC
+\**********************************************************************/
+bool
+QueryServer::listen(const QString& socketName)
+{
+	// Don't take over the socket of a running server. Otherwise, the socket
+	// file was left behind by a crashed server.
+	QLocalSocket probe;
+	probe.connectToServer(socketName);
+	if (probe.waitForConnected(1000))
+	{
+		qWarning() << "Another server is already listening on" << socketName;
+		return false;
+	}
+	QLocalServer::removeServer(socketName);
+
+	_server->setSocketOptions(QLocalServer::UserAccessOption);
+	if (!_server->listen(socketName))
+	{
+		qWarning() << "Listening on" << socketName << ':' << _server->errorString();
+		return false;
+	}
+	return true;
+}
+
+int
+QueryServer::query(const QString& socketName, const QStringList& requests)
+{
+	QLocalSocket socket;
+	socket.connectToServer(socketName);
+	if (!socket.waitForConnected(5000))
+	{
+		fprintf(stderr, "Can't connect to %s: %s\n", qPrintable(socketName), qPrintable(socket.errorString()));
+		return 1;
+	}
+
+	// Requests may span multiple lines, but they are sent as single lines
+	for (const QString& request : requests)
+	{
+		QJsonDocument doc = QJsonDocument::fromJson(request.toUtf8());
+		if (doc.isObject())
+			socket.write(doc.toJson(QJsonDocument::Compact) + '\n');
+		else
+			socket.write(request.simplified().toUtf8() + '\n');
+	}
+
+	int failures = 0;
+	int pending = requests.size();
+	while (pending > 0)
+	{
+		if (!socket.canReadLine() && !socket.waitForReadyRead(60000))
+		{
+			fprintf(stderr, "No response: %s\n", qPrintable(socket.errorString()));
+			return 1;
+		}
+
+		while (pending > 0 && socket.canReadLine())
+		{
+			QByteArray line = socket.readLine();
+			fputs(line.constData(), stdout);
+			fflush(stdout);
+
+			if (!QJsonDocument::fromJson(line).object().value("ok").toBool())
+				++failures;
+			--pending;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}
+
+/**********************************************************************\
+ * PRIVATE SLOTS
+\**********************************************************************/
+void
+QueryServer::acceptConnections()
+{
+	while (QLocalSocket* socket = _server->nextPendingConnection())
+	{
+		int clientId = _nextClientId++;
+		_clients[clientId] = socket;
+
+		connect(socket, &QLocalSocket::readyRead, [=]()
+		{
+			readRequests(clientId);
+		});
+		connect(socket, &QLocalSocket::disconnected, [=]()
+		{
+			_clients.remove(clientId);
+			socket->deleteLater();
+		});
+	}
+}
+
+// The client may have disconnected while its query was running
+void
+QueryServer::sendResponse(int clientId, const QByteArray& response)
+{
+	if (QLocalSocket* socket = _clients.value(clientId))
+		socket->write(response);
+}
+
+/**********************************************************************\
+ * PRIVATE
+\**********************************************************************/
+void
+QueryServer::readRequests(int clientId)
+{
+	QLocalSocket* socket = _clients.value(clientId);
+	if (!socket)
+		return;
+
+	while (socket->canReadLine())
+	{
+		QByteArray line = socket->readLine().trimmed();
+		if (!line.isEmpty())
+			processRequest(clientId, line);
+	}
+
+	if (socket->bytesAvailable() > maxRequestSize)
+	{
+		sendResponse(clientId, response(QJsonValue::Undefined, QJsonValue(), "Request too long"));
+		socket->disconnectFromServer();
+	}
+}
+
+void
+QueryServer::processRequest(int clientId, const QByteArray& line)
+{
+	QJsonParseError parseError;
+	QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+	if (!doc.isObject())
+	{
+		QString error = parseError.error != QJsonParseError::NoError ? parseError.errorString() : "Expected an object";
+		sendResponse(clientId, response(QJsonValue::Undefined, QJsonValue(), "Invalid request: " + error));
+		return;
+	}
+
+	QJsonObject request = doc.object();
+	QString query = request.value("query").toString();
+	QJsonValue requestId = request.value("id");
+
+	// Pick up sessions which were added or deleted by the GUI
+	_database->refreshSessions();
+
+	// Resolve the sessions here, where the Database lives. Only the
+	// (slow) row queries are run in the pool.
+	QueryFunction function;
+	QString requestError;
+	if (query == "sessions")
+	{
+		QJsonArray sessions;
+		for (const QString& session : _database->sessions())
+			sessions.append(session);
+
+		sendResponse(clientId, response(requestId, sessions, QString()));
+		return;
+	}
+	else if (query == "summary")
+	{
+		QString session = request.value("session").toString();
+		QString rows = _database->rowSelection(session);
+		if (rows.isEmpty())
+			requestError = "Unknown session: " + session;
+
+		// The unrecorded lines are just a summary, which is quick to load
+		QJsonObject unrecorded;
+		UnrecordedLines lines = _database->unrecordedLines(session);
+		for (int c = 0; c < UnrecordedLines::CategoryCount; ++c)
+			unrecorded[UnrecordedLines::categoryName(c)] = lines.count(c);
+
+		function = [=](QSqlDatabase& db, QString* error)
+		{
+			QJsonObject summary = summarize(db, rows, error).toObject();
+			summary["session"] = session;
+			summary["unrecorded"] = unrecorded;
+			return QJsonValue(summary);
+		};
+	}
+	else if (query == "diff")
+	{
+		QString session1 = request.value("session1").toString();
+		QString session2 = request.value("session2").toString();
+		QString removedRows = _database->uniqueRowSelection(session1, session2);
+		QString addedRows = _database->uniqueRowSelection(session2, session1);
+		if (removedRows.isEmpty())
+			requestError = "Unknown session: " + (_database->rowSelection(session1).isEmpty() ? session1 : session2);
+
+		function = [=](QSqlDatabase& db, QString* error)
+		{
+			QJsonObject diff;
+			diff["session1"] = session1;
+			diff["session2"] = session2;
+			diff["removed"] = listRows(db, removedRows, error);
+			if (error->isEmpty())
+				diff["added"] = listRows(db, addedRows, error);
+			return QJsonValue(diff);
+		};
+	}
+	else if (query == "history")
+	{
+		int errorId = int(request.value("error").toDouble());
+		QString path = request.value("path").toString();
+		QString message = request.value("message").toString();
+		if (errorId <= 0 && (path.isEmpty() || message.isEmpty()))
+			requestError = "Expected an error ID, or a path and a message";
+
+		QMap<int, QString> sessionNames = _database->sessionNames();
+		function = [=](QSqlDatabase& db, QString* error)
+		{
+			return history(db, errorId, path, message, sessionNames, error);
+		};
+	}
+	else
+		requestError = "Unknown query: " + query;
+
+	if (!requestError.isEmpty())
+	{
+		sendResponse(clientId, response(requestId, QJsonValue(), requestError));
+		return;
+	}
+
+	_pool.start(new QueryTask(this, clientId, requestId, _database->fileName(), function));
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QThreadPool>
+#include <QStringList>
+
+class Database;
+class QLocalServer;
+class QLocalSocket;
+
+// Answers read-only queries over a local socket (a Unix domain socket on
+// Unix). Each request and each response is a JSON object on a single line:
+//
+//   {"query": "sessions"}
+//   {"query": "summary", "session": "..."}
+//   {"query": "diff", "session1": "...", "session2": "..."}
+//   {"query": "history", "error": 123}
+//   {"query": "history", "path": "repo/file", "message": "..."}
+//
+// Responses contain {"ok": true, "result": ...} or {"ok": false, "error": "..."}.
+// A diff lists the errors that were "removed" from session1 and "added" in
+// session2. The history of an error lists the sessions that contain it.
+// The "id" of a request is copied into its response, as the responses to
+// concurrent requests can arrive out of order.
+//
+// The sessions are resolved by the Database (opened as Database::ReadOnly),
+// in this object's thread. The queries then run in a thread pool, where each
+// thread has its own read-only connection.
+class QueryServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit QueryServer(Database* database, QObject* parent = nullptr);
+	~QueryServer();
+
+	bool listen(const QString& socketName);
+
+	// Sends the requests at once, and prints the responses to stdout as they
+	// arrive. Returns 0 if all of the queries succeeded. For testing.
+	static int query(const QString& socketName, const QStringList& requests);
+
+private slots:
+	void acceptConnections();
+	void sendResponse(int clientId, const QByteArray& response);
+
+private:
+	void readRequests(int clientId);
+	void processRequest(int clientId, const QByteArray& line);
+
+	Database* _database;
+	QLocalServer* _server;
+	QHash<int, QLocalSocket*> _clients;
+	int _nextClientId;
+	QThreadPool _pool;
+};
+
+#endif // QUERYSERVER_H
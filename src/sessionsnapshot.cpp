@@ -0,0 +1,421 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "sessionsnapshot.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QSplitter>
+#include <QLabel>
+#include <QPushButton>
+#include <QTableView>
+#include <QHeaderView>
+#include <QSortFilterProxyModel>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QHash>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+static const char snapshotMagic[8] = {'Q', 'D', 'E', 'T', 'S', 'N', 'A', 'P'};
+static const quint32 currentVersion = 1;
+static const quint32 byteOrderMark = 0x01020304;
+
+static qint64
+alignTo8(qint64 offset)
+{
+	return (offset + 7) & ~qint64(7);
+}
+
+//======================================================================
+// SESSIONSNAPSHOT
+//======================================================================
+SessionSnapshot::SessionSnapshot(const QString& filename)
+	: _file(filename)
+	, _header(nullptr)
+	, _keys(nullptr)
+	, _errors(nullptr)
+	, _lines(nullptr)
+	, _stringOffsets(nullptr)
+	, _chars(nullptr)
+{
+	if (!_file.open(QFile::ReadOnly))
+	{
+		_errorString = _file.errorString();
+		return;
+	}
+
+	const uchar* data = _file.size() >= qint64(sizeof(Header)) ? _file.map(0, _file.size()) : nullptr;
+	auto header = reinterpret_cast<const Header*>(data);
+	if (!header || memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0)
+	{
+		_errorString = "Not a snapshot";
+		return;
+	}
+	if (header->version != currentVersion)
+	{
+		_errorString = "Unsupported snapshot version";
+		return;
+	}
+	if (header->byteOrder != byteOrderMark)
+	{
+		_errorString = "The snapshot was written on a machine with a different byte order";
+		return;
+	}
+
+	Layout l = layout(header->entryCount, header->stringCount, header->charCount);
+	if (l.size != _file.size())
+	{
+		_errorString = "The snapshot is truncated";
+		return;
+	}
+
+	_keys = reinterpret_cast<const quint64*>(data + l.keys);
+	_errors = reinterpret_cast<const ErrorStrings*>(data + l.errors);
+	_lines = reinterpret_cast<const quint32*>(data + l.lines);
+	_stringOffsets = reinterpret_cast<const quint32*>(data + l.stringOffsets);
+	_chars = reinterpret_cast<const QChar*>(data + l.chars);
+
+	_header = header;
+	if (!validate())
+	{
+		_header = nullptr;
+		_errorString = "The snapshot is corrupt";
+	}
+}
+
+bool
+SessionSnapshot::write(const QString& filename, const QDateTime& timestamp,
+		const QString& comments, const SessionTable& table)
+{
+	// Intern the strings. String 0 is the empty string.
+	QHash<QString, quint32> stringIndices;
+	QVector<quint32> stringOffsets;
+	QString chars;
+	auto intern = [&](const QString& str) -> quint32
+	{
+		auto it = stringIndices.constFind(str);
+		if (it != stringIndices.constEnd())
+			return it.value();
+
+		quint32 index = stringOffsets.size();
+		stringOffsets << chars.size();
+		chars += str;
+		stringIndices.insert(str, index);
+		return index;
+	};
+	intern(QString());
+	quint32 commentsIndex = intern(comments);
+
+	// Sort the entries by error, then by line, so that snapshots can be merged
+	QVector<quint64> rowKeys(table.size());
+	QVector<int> order(table.size());
+	for (int i = 0; i < table.size(); ++i)
+	{
+		const SessionRow& row = table[i];
+		rowKeys[i] = ParsedLog::errorHash(QStringRef(&row.repo), QStringRef(&row.file), QStringRef(&row.message));
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) -> bool
+	{
+		if (rowKeys[a] != rowKeys[b])
+			return rowKeys[a] < rowKeys[b];
+		return table[a].line < table[b].line;
+	});
+
+	QVector<quint64> keys;
+	QVector<ErrorStrings> errors;
+	QVector<quint32> lines;
+	keys.reserve(table.size());
+	errors.reserve(table.size());
+	lines.reserve(table.size());
+	for (int i : order)
+	{
+		const SessionRow& row = table[i];
+		ErrorStrings strings;
+		strings.repo = intern(row.repo);
+		strings.file = intern(row.file);
+		strings.message = intern(row.message);
+		strings.notes = intern(row.notes);
+
+		keys << rowKeys[i];
+		errors << strings;
+		lines << quint32(row.line);
+	}
+	stringOffsets << chars.size(); // End of the last string
+
+	Header header;
+	memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+	header.version = currentVersion;
+	header.byteOrder = byteOrderMark;
+	header.timestamp = timestamp.toMSecsSinceEpoch();
+	header.comments = commentsIndex;
+	header.entryCount = table.size();
+	header.stringCount = stringOffsets.size() - 1;
+	header.charCount = chars.size();
+
+	QFile file(filename);
+	if (!file.open(QFile::WriteOnly|QFile::Truncate))
+	{
+		qWarning() << "Writing snapshot:" << file.errorString();
+		return false;
+	}
+
+	// Pad the gaps between the arrays with zeros
+	auto writeAt = [&](qint64 offset, const void* data, qint64 size)
+	{
+		if (file.pos() < offset)
+			file.write(QByteArray(offset - file.pos(), '\0'));
+		return file.write(static_cast<const char*>(data), size) == size;
+	};
+
+	Layout l = layout(header.entryCount, header.stringCount, header.charCount);
+	bool ok = writeAt(0, &header, sizeof(header))
+			&& writeAt(l.keys, keys.constData(), keys.size() * sizeof(quint64))
+			&& writeAt(l.errors, errors.constData(), errors.size() * sizeof(ErrorStrings))
+			&& writeAt(l.lines, lines.constData(), lines.size() * sizeof(quint32))
+			&& writeAt(l.stringOffsets, stringOffsets.constData(), stringOffsets.size() * sizeof(quint32))
+			&& writeAt(l.chars, chars.constData(), chars.size() * sizeof(QChar));
+	if (!ok)
+	{
+		qWarning() << "Writing snapshot:" << file.errorString();
+		file.remove();
+		return false;
+	}
+	return true;
+}
+
+QDateTime
+SessionSnapshot::timestamp() const
+{
+	return _header ? QDateTime::fromMSecsSinceEpoch(_header->timestamp) : QDateTime();
+}
+
+QString
+SessionSnapshot::comments() const
+{
+	return _header ? string(_header->comments) : QString();
+}
+
+// Both key arrays are sorted, so a single merge pass finds the differences
+QVector<int>
+SessionSnapshot::uniqueEntries(const SessionSnapshot& other) const
+{
+	QVector<int> entries;
+	int j = 0;
+	for (int i = 0; i < count(); ++i)
+	{
+		while (j < other.count() && other.key(j) < key(i))
+			++j;
+		if (j == other.count() || other.key(j) != key(i))
+			entries << i;
+	}
+	return entries;
+}
+
+SessionSnapshot::Layout
+SessionSnapshot::layout(quint32 entryCount, quint32 stringCount, quint32 charCount)
+{
+	Layout l;
+	l.keys = alignTo8(sizeof(Header));
+	l.errors = alignTo8(l.keys + qint64(entryCount) * sizeof(quint64));
+	l.lines = alignTo8(l.errors + qint64(entryCount) * sizeof(ErrorStrings));
+	l.stringOffsets = alignTo8(l.lines + qint64(entryCount) * sizeof(quint32));
+	l.chars = alignTo8(l.stringOffsets + (qint64(stringCount) + 1) * sizeof(quint32));
+	l.size = l.chars + qint64(charCount) * sizeof(QChar);
+	return l;
+}
+
+// Checks the indices, so that a damaged file can't cause out-of-bounds reads
+bool
+SessionSnapshot::validate()
+{
+	if (_stringOffsets[0] != 0 || _stringOffsets[_header->stringCount] != _header->charCount)
+		return false;
+	for (quint32 s = 0; s < _header->stringCount; ++s)
+	{
+		if (_stringOffsets[s] > _stringOffsets[s + 1])
+			return false;
+	}
+
+	quint32 stringCount = _header->stringCount;
+	if (_header->comments >= stringCount)
+		return false;
+	for (int i = 0; i < count(); ++i)
+	{
+		const ErrorStrings& strings = _errors[i];
+		if (strings.repo >= stringCount || strings.file >= stringCount
+				|| strings.message >= stringCount || strings.notes >= stringCount)
+		{
+			return false;
+		}
+		if (i > 0 && _keys[i - 1] > _keys[i])
+			return false;
+	}
+	return true;
+}
+
+QString
+SessionSnapshot::string(quint32 index) const
+{
+	return QString(_chars + _stringOffsets[index], _stringOffsets[index + 1] - _stringOffsets[index]);
+}
+
+//======================================================================
+// SNAPSHOTMODEL
+//======================================================================
+SnapshotModel::SnapshotModel(const QSharedPointer<SessionSnapshot>& snapshot,
+		const QVector<int>& entries, QObject* parent)
+	: QAbstractTableModel(parent)
+	, _snapshot(snapshot)
+	, _entries(entries)
+{}
+
+int
+SnapshotModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return _entries.size();
+}
+
+int
+SnapshotModel::columnCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return ColumnCount;
+}
+
+QVariant
+SnapshotModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	int i = _entries[index.row()];
+	switch (index.column())
+	{
+	case RepoColumn: return _snapshot->repo(i);
+	case FileColumn: return _snapshot->file(i);
+	case LineColumn: return _snapshot->line(i);
+	case MessageColumn: return _snapshot->message(i);
+	case NotesColumn: return _snapshot->notes(i);
+	}
+	return QVariant();
+}
+
+QVariant
+SnapshotModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QAbstractTableModel::headerData(section, orientation, role);
+
+	switch (section)
+	{
+	case RepoColumn: return "repo";
+	case FileColumn: return "file";
+	case LineColumn: return "line";
+	case MessageColumn: return "message";
+	case NotesColumn: return "notes";
+	}
+	return QVariant();
+}
+
+//======================================================================
+// SNAPSHOTVIEWER
+//======================================================================
+SnapshotViewer::SnapshotViewer(const QSharedPointer<SessionSnapshot>& snapshot, QWidget* parent)
+	: QWidget(parent)
+	, _snapshot(snapshot)
+	, _label_L(new QLabel)
+	, _label_R(new QLabel)
+	, _view_L(new QTableView)
+	, _view_R(new QTableView)
+{
+	auto compareButton = new QPushButton("Compare With Snapshot...");
+	auto buttonLayout = new QHBoxLayout;
+	buttonLayout->addWidget(compareButton);
+	buttonLayout->addStretch();
+
+	// The right side is only used for diffs
+	auto splitter = new QSplitter;
+	for (auto pair : {qMakePair(_label_L, _view_L), qMakePair(_label_R, _view_R)})
+	{
+		pair.second->setSortingEnabled(true);
+		pair.second->horizontalHeader()->setStretchLastSection(true);
+
+		auto side = new QWidget;
+		auto sideLayout = new QVBoxLayout(side);
+		sideLayout->setContentsMargins(0, 0, 0, 0);
+		sideLayout->addWidget(pair.first);
+		sideLayout->addWidget(pair.second);
+		splitter->addWidget(side);
+	}
+	splitter->widget(1)->hide();
+
+	auto layout = new QVBoxLayout(this);
+	layout->addLayout(buttonLayout);
+	layout->addWidget(splitter);
+
+	QVector<int> entries(_snapshot->count());
+	for (int i = 0; i < entries.size(); ++i)
+		entries[i] = i;
+
+	_label_L->setText(QString("%1 errors").arg(entries.size()));
+	setModel(_view_L, new SnapshotModel(_snapshot, entries, this));
+
+	connect(compareButton, &QPushButton::clicked, [=]()
+	{
+		QString filename = QFileDialog::getOpenFileName(this, "Open Snapshot",
+				QFileInfo(_snapshot->fileName()).path(), "Snapshots (*.qdetsnap);;All files (*)");
+		if (filename.isEmpty())
+			return;
+
+		compareWith(filename);
+		splitter->widget(1)->show();
+	});
+
+	setWindowTitle("Snapshot - " + Database::simplifyEntry(_snapshot->timestamp(), _snapshot->comments()));
+	setAttribute(Qt::WA_DeleteOnClose);
+	resize(900, 600);
+}
+
+void
+SnapshotViewer::compareWith(const QString& filename)
+{
+	QSharedPointer<SessionSnapshot> other(new SessionSnapshot(filename));
+	if (!other->isValid())
+	{
+		QMessageBox::warning(this, "Error", "Can't open " + filename + ": " + other->errorString());
+		return;
+	}
+
+	QVector<int> entries_L = _snapshot->uniqueEntries(*other);
+	QVector<int> entries_R = other->uniqueEntries(*_snapshot);
+
+	QString name_L = Database::simplifyEntry(_snapshot->timestamp(), _snapshot->comments());
+	QString name_R = Database::simplifyEntry(other->timestamp(), other->comments());
+	_label_L->setText(QString("Only in %1 (%2 errors)").arg(name_L).arg(entries_L.size()));
+	_label_R->setText(QString("Only in %1 (%2 errors)").arg(name_R).arg(entries_R.size()));
+
+	setModel(_view_L, new SnapshotModel(_snapshot, entries_L, this));
+	setModel(_view_R, new SnapshotModel(other, entries_R, this));
+}
+
+void
+SnapshotViewer::setModel(QTableView* view, QAbstractTableModel* model)
+{
+	auto oldProxy = qobject_cast<QSortFilterProxyModel*>(view->model());
+	auto newProxy = new QSortFilterProxyModel(this);
+
+	newProxy->setSourceModel(model);
+	view->setModel(newProxy);
+
+	if (oldProxy)
+	{
+		oldProxy->sourceModel()->deleteLater();
+		oldProxy->deleteLater();
+	}
+}
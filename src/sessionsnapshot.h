@@ -0,0 +1,150 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef SESSIONSNAPSHOT_H
+#define SESSIONSNAPSHOT_H
+
+#include "database.h"
+#include <QAbstractTableModel>
+#include <QWidget>
+#include <QFile>
+#include <QSharedPointer>
+
+class QLabel;
+class QTableView;
+
+// A session in a standalone, memory-mapped file. Snapshots can be browsed
+// and compared without parsing them, or merging them into a database.
+//
+// File layout (native byte order; each array starts on an 8-byte boundary):
+//   Header
+//   quint64 keys[entryCount]          Sorted. See ParsedLog::errorHash()
+//   ErrorStrings errors[entryCount]   String indices
+//   quint32 lines[entryCount]
+//   quint32 stringOffsets[stringCount + 1]
+//   ushort chars[charCount]           UTF-16 string table
+class SessionSnapshot
+{
+public:
+	explicit SessionSnapshot(const QString& filename);
+
+	static bool write(const QString& filename, const QDateTime& timestamp,
+			const QString& comments, const SessionTable& table);
+
+	bool isValid() const {return _header != nullptr;}
+	QString errorString() const {return _errorString;}
+	QString fileName() const {return _file.fileName();}
+
+	QDateTime timestamp() const;
+	QString comments() const;
+
+	// Entries are sorted by error, then by line
+	int count() const {return _header ? int(_header->entryCount) : 0;}
+	quint64 key(int i) const {return _keys[i];}
+	QString repo(int i) const {return string(_errors[i].repo);}
+	QString file(int i) const {return string(_errors[i].file);}
+	QString message(int i) const {return string(_errors[i].message);}
+	QString notes(int i) const {return string(_errors[i].notes);}
+	int line(int i) const {return int(_lines[i]);}
+
+	// Entries whose errors aren't in the other snapshot
+	QVector<int> uniqueEntries(const SessionSnapshot& other) const;
+
+private:
+	struct Header
+	{
+		char magic[8];
+		quint32 version;
+		quint32 byteOrder;
+		qint64 timestamp; // Milliseconds since the epoch, UTC
+		quint32 comments; // String index
+		quint32 entryCount;
+		quint32 stringCount;
+		quint32 charCount;
+	};
+
+	struct ErrorStrings
+	{
+		quint32 repo;
+		quint32 file;
+		quint32 message;
+		quint32 notes;
+	};
+
+	// Byte offsets of the arrays
+	struct Layout
+	{
+		qint64 keys;
+		qint64 errors;
+		qint64 lines;
+		qint64 stringOffsets;
+		qint64 chars;
+		qint64 size;
+	};
+	static Layout layout(quint32 entryCount, quint32 stringCount, quint32 charCount);
+
+	bool validate();
+	QString string(quint32 index) const; // Points into the mapped file
+
+	QFile _file;
+	QString _errorString;
+
+	const Header* _header;
+	const quint64* _keys;
+	const ErrorStrings* _errors;
+	const quint32* _lines;
+	const quint32* _stringOffsets;
+	const QChar* _chars;
+
+	Q_DISABLE_COPY(SessionSnapshot)
+};
+
+class SnapshotModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+public:
+	// Shows the given entries of the snapshot
+	SnapshotModel(const QSharedPointer<SessionSnapshot>& snapshot,
+			const QVector<int>& entries, QObject* parent = nullptr);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+private:
+	enum Column
+	{
+		RepoColumn,
+		FileColumn,
+		LineColumn,
+		MessageColumn,
+		NotesColumn,
+		ColumnCount
+	};
+
+	QSharedPointer<SessionSnapshot> _snapshot;
+	QVector<int> _entries;
+};
+
+// Browses a snapshot, or the diff between two snapshots
+class SnapshotViewer : public QWidget
+{
+	Q_OBJECT
+
+public:
+	explicit SnapshotViewer(const QSharedPointer<SessionSnapshot>& snapshot, QWidget* parent = nullptr);
+
+private:
+	void compareWith(const QString& filename);
+	void setModel(QTableView* view, QAbstractTableModel* model);
+
+	QSharedPointer<SessionSnapshot> _snapshot;
+	QLabel* _label_L;
+	QLabel* _label_R;
+	QTableView* _view_L;
+	QTableView* _view_R;
+};
+
+#endif // SESSIONSNAPSHOT_H
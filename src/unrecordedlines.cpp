@@ -0,0 +1,234 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#include "unrecordedlines.h"
+#include <QVBoxLayout>
+#include <QComboBox>
+#include <QListView>
+
+static const int maxSamples = 10;
+
+//======================================================================
+// UNRECORDEDLINES
+//======================================================================
+UnrecordedLines::UnrecordedLines()
+	: _counts(CategoryCount, 0)
+	, _samples(CategoryCount)
+{}
+
+UnrecordedLines::Category
+UnrecordedLines::classify(const QString& line)
+{
+	if (line.startsWith("make") || line.startsWith("mingw32-make") || line.startsWith("nmake")
+			|| line.startsWith("jom") || line.startsWith("cd ")
+			|| line.contains("Entering directory") || line.contains("Leaving directory"))
+	{
+		return MakeOutput;
+	}
+
+	// Diagnostics come first, as their paths can contain "qdoc" too
+	// (e.g. "qttools/src/qdoc/...: error: ...")
+	if (line.contains(": error") || line.contains(": warning") || line.contains(": note:")
+			|| line.contains(": In ") || line.startsWith("In file included from"))
+	{
+		return CompilerOutput;
+	}
+
+	// QDoc's own output ("qdoc: ...") and the commands that run it
+	if (line.startsWith("qdoc", Qt::CaseInsensitive) || line.contains("/qdoc ")
+			|| line.contains("qdoc.exe", Qt::CaseInsensitive))
+	{
+		return QDocNote;
+	}
+
+	return OtherOutput;
+}
+
+QString
+UnrecordedLines::categoryName(int category)
+{
+	switch (category)
+	{
+	case CompilerOutput: return "Compiler output";
+	case MakeOutput: return "Make output";
+	case QDocNote: return "QDoc notes";
+	default: return "Other";
+	}
+}
+
+void
+UnrecordedLines::append(qint64 offset, const QString& line)
+{
+	Category category = classify(line);
+
+	_offsets << offset;
+	_categories << category;
+
+	++_counts[category];
+	if (_samples[category].size() < maxSamples)
+		_samples[category] << line;
+}
+
+void
+UnrecordedLines::merge(const UnrecordedLines& other)
+{
+	QVector<qint64> offsets;
+	QVector<quint8> categories;
+	offsets.reserve(_offsets.size() + other._offsets.size());
+	categories.reserve(offsets.capacity());
+
+	int i = 0;
+	int j = 0;
+	while (i < _offsets.size() || j < other._offsets.size())
+	{
+		if (j == other._offsets.size() || (i < _offsets.size() && _offsets[i] < other._offsets[j]))
+		{
+			offsets << _offsets[i];
+			categories << _categories[i++];
+		}
+		else
+		{
+			offsets << other._offsets[j];
+			categories << other._categories[j++];
+		}
+	}
+	_offsets = offsets;
+	_categories = categories;
+
+	for (int c = 0; c < CategoryCount; ++c)
+	{
+		_counts[c] += other._counts[c];
+		for (const QString& line : other._samples[c])
+		{
+			if (_samples[c].size() < maxSamples)
+				_samples[c] << line;
+		}
+	}
+}
+
+void
+UnrecordedLines::setSummary(int category, int count, const QStringList& samples)
+{
+	_counts[category] = count;
+	_samples[category] = samples;
+}
+
+int
+UnrecordedLines::totalCount() const
+{
+	int total = 0;
+	for (int count : _counts)
+		total += count;
+	return total;
+}
+
+//======================================================================
+// UNRECORDEDLINESMODEL
+//======================================================================
+UnrecordedLinesModel::UnrecordedLinesModel(const UnrecordedLines& lines, const QString& logFilename, QObject* parent)
+	: QAbstractListModel(parent)
+	, _lines(lines)
+	, _file(logFilename)
+	, _cache(1000)
+{
+	if (_lines.count() > 0 && !logFilename.isEmpty())
+		_file.open(QFile::ReadOnly|QFile::Text);
+
+	setCategory(-1);
+}
+
+void
+UnrecordedLinesModel::setCategory(int category)
+{
+	beginResetModel();
+
+	_rows.clear();
+	_sampleRows.clear();
+	if (_file.isOpen())
+	{
+		for (int i = 0; i < _lines.count(); ++i)
+		{
+			if (category < 0 || _lines.category(i) == category)
+				_rows << i;
+		}
+	}
+	else
+	{
+		for (int c = 0; c < UnrecordedLines::CategoryCount; ++c)
+		{
+			if (category < 0 || c == category)
+				_sampleRows << _lines.samples(c);
+		}
+	}
+
+	endResetModel();
+}
+
+int
+UnrecordedLinesModel::rowCount(const QModelIndex& parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return _file.isOpen() ? _rows.size() : _sampleRows.size();
+}
+
+QVariant
+UnrecordedLinesModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	if (_file.isOpen())
+		return readLine(_rows[index.row()]);
+	return _sampleRows[index.row()];
+}
+
+QString
+UnrecordedLinesModel::readLine(int i) const
+{
+	if (QString* line = _cache.object(i))
+		return *line;
+
+	_file.seek(_lines.offset(i));
+	QString line = _file.readLine();
+	line.remove('\n');
+
+	_cache.insert(i, new QString(line));
+	return line;
+}
+
+//======================================================================
+// UNRECORDEDLINESVIEWER
+//======================================================================
+UnrecordedLinesViewer::UnrecordedLinesViewer(const UnrecordedLines& lines, const QString& logFilename, QWidget* parent)
+	: QWidget(parent)
+{
+	auto model = new UnrecordedLinesModel(lines, logFilename, this);
+
+	auto categoryBox = new QComboBox;
+	categoryBox->addItem(QString("All (%1)").arg(lines.totalCount()), -1);
+	for (int c = 0; c < UnrecordedLines::CategoryCount; ++c)
+	{
+		categoryBox->addItem(QString("%1 (%2)")
+				.arg(UnrecordedLines::categoryName(c))
+				.arg(lines.count(c)), c);
+	}
+
+	// Only the visible lines are read from the log
+	auto view = new QListView;
+	view->setUniformItemSizes(true);
+	view->setModel(model);
+
+	auto layout = new QVBoxLayout(this);
+	layout->addWidget(categoryBox);
+	layout->addWidget(view);
+
+	connect(categoryBox, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged), [=]()
+	{
+		model->setCategory(categoryBox->itemData(categoryBox->currentIndex()).toInt());
+	});
+
+	setWindowTitle("Unrecorded Lines");
+	setAttribute(Qt::WA_DeleteOnClose);
+	resize(600, 480);
+}
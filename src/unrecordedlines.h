@@ -0,0 +1,90 @@
+// Copyright (c) 2014 Sze Howe Koh
+// This code is licensed under the MIT license (see LICENSE.txt for details)
+
+#ifndef UNRECORDEDLINES_H
+#define UNRECORDEDLINES_H
+
+#include <QAbstractListModel>
+#include <QWidget>
+#include <QStringList>
+#include <QVector>
+#include <QFile>
+#include <QCache>
+
+// Index of the lines in a log that aren't QDoc warnings. Only the file
+// offsets are kept, plus a few sample lines from each category.
+class UnrecordedLines
+{
+public:
+	enum Category
+	{
+		CompilerOutput,
+		MakeOutput,
+		QDocNote,
+		OtherOutput,
+		CategoryCount
+	};
+
+	UnrecordedLines();
+
+	static Category classify(const QString& line);
+	static QString categoryName(int category);
+
+	void append(qint64 offset, const QString& line);
+	void merge(const UnrecordedLines& other); // Keeps the lines in file order
+
+	// Only the summary is stored in the database
+	void setSummary(int category, int count, const QStringList& samples);
+
+	// Indexed lines
+	int count() const {return _offsets.size();}
+	qint64 offset(int i) const {return _offsets[i];}
+	int category(int i) const {return _categories[i];}
+
+	// Summary
+	int count(int category) const {return _counts[category];}
+	int totalCount() const;
+	QStringList samples(int category) const {return _samples[category];}
+
+private:
+	QVector<qint64> _offsets;
+	QVector<quint8> _categories;
+
+	QVector<int> _counts;
+	QVector<QStringList> _samples;
+};
+
+class UnrecordedLinesModel : public QAbstractListModel
+{
+	Q_OBJECT
+
+public:
+	// Lines are read from the log file on demand. If the file is not
+	// available, only the sample lines are shown.
+	UnrecordedLinesModel(const UnrecordedLines& lines, const QString& logFilename, QObject* parent = nullptr);
+
+	void setCategory(int category); // -1 shows all categories
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+
+private:
+	QString readLine(int i) const;
+
+	UnrecordedLines _lines;
+	QVector<int> _rows; // Index of each visible line
+	QStringList _sampleRows;
+
+	mutable QFile _file;
+	mutable QCache<int, QString> _cache;
+};
+
+class UnrecordedLinesViewer : public QWidget
+{
+	Q_OBJECT
+
+public:
+	UnrecordedLinesViewer(const UnrecordedLines& lines, const QString& logFilename = QString(), QWidget* parent = nullptr);
+};
+
+#endif // UNRECORDEDLINES_H